@@ -0,0 +1,105 @@
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <opencv2/opencv.hpp>
+
+#include <pipeline/clock.hpp>
+#include <pipeline/codec.hpp>
+#include <pipeline/recording.hpp>
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+ * \brief Measures how long every codec takes to encode a set of
+ *  recorded frames and how many bytes it produces.
+ */
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        std::cerr << "Usage 'codec_benchmark frames_folder_or_video [repetitions]'" << std::endl;
+        return 1;
+    }
+    const int repetitions = argc > 2 ? std::atoi(argv[2]) : 3;
+    if (repetitions < 1) {
+        std::cerr << "The repetitions must be a number of at least 1" << std::endl
+                  << "Usage 'codec_benchmark frames_folder_or_video [repetitions]'" << std::endl;
+        return 1;
+    }
+
+    std::vector<cv::Mat> frames = pipeline::load_frames(argv[1], 300);
+    if (frames.empty()) {
+        std::cerr << "No frames found in " << argv[1] << std::endl;
+        return 1;
+    }
+    std::cout << "Frames: " << frames.size() << " of "
+              << frames[0].cols << "x" << frames[0].rows << std::endl;
+
+    /*
+     * The first codec is the one the tutorials used before,
+     * the others are compared with it.
+     */
+    const std::vector<pipeline::codec> codecs = {
+        pipeline::codec::make_png(3),
+        pipeline::codec::make_png(1),
+        pipeline::codec::make_png(9),
+        pipeline::codec::make_png(3, true),
+        pipeline::codec::make_jpeg(95),
+        pipeline::codec::make_jpeg(90),
+        pipeline::codec::make_jpeg(75),
+        pipeline::codec::make_jpeg(85, true),
+        pipeline::codec::make_jpeg(70, true),
+        pipeline::codec::make_bmp(),
+        pipeline::codec::make_bmp(true)
+    };
+
+    std::cout << std::left << std::setw(16) << "codec"
+              << std::right << std::setw(12) << "ms/frame"
+              << std::setw(12) << "KB/frame"
+              << std::setw(10) << "time %"
+              << std::setw(10) << "size %" << std::endl;
+
+    double base_ms = 0;
+    double base_kb = 0;
+    std::vector<rapp::types::byte> buf;
+    for (const auto & format : codecs) {
+        double bytes = 0;
+        const auto start = pipeline::clock::now();
+        for (int r = 0; r < repetitions; ++r) {
+            for (const auto & image : frames) {
+                format.encode(image, buf);
+                bytes += buf.size();
+            }
+        }
+        const double encoded = double(repetitions) * frames.size();
+        const double ms = boost::chrono::duration<double, boost::milli>(pipeline::clock::now() - start).count() / encoded;
+        const double kb = bytes / encoded / 1024;
+        if (base_ms == 0) {
+            base_ms = ms;
+            base_kb = kb;
+        }
+        std::cout << std::left << std::setw(16) << format.name()
+                  << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(12) << ms
+                  << std::setw(12) << kb
+                  << std::setprecision(0)
+                  << std::setw(10) << 100 * ms / base_ms
+                  << std::setw(10) << 100 * kb / base_kb << std::endl;
+    }
+    return 0;
+}
@@ -18,98 +18,166 @@
 #include <rapp/cloud/vision_detection.hpp>
 #include <rapp/objects/picture.hpp>
 
-#include <boost/date_time/posix_time/posix_time.hpp>
-#include <boost/thread/thread.hpp> 
+#include <pipeline/display_stage.hpp>
+#include <pipeline/latency.hpp>
+#include <pipeline/overlay.hpp>
+#include <pipeline/result_sink.hpp>
+#include <pipeline/service_runtime.hpp>
+#include <pipeline/stop_signal.hpp>
 
 #include <functional>
 #include <iostream>
-#include <chrono>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <utility>
 
 /*
  * \brief Example of face_detection showing the result in
  *  a opencv interface.
  */
-int main()
+int main(int argc, char* argv[])
 {
+    /*
+     * `--headless` runs without any window, e.g. on a robot or a server,
+     * and `--output file` writes the results in that file instead of
+     * the console, one JSON line per frame.
+     */
+    bool headless = !pipeline::display_stage::available();
+    std::string output;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--headless") {
+            headless = true;
+        }
+        else if (arg == "--output" && i + 1 < argc) {
+            output = argv[++i];
+        }
+    }
+
+    /*
+     * Ctrl+C or SIGTERM stop the program, and the stages
+     * still stop in order when they go out of scope.
+     */
+    pipeline::stop_signal stop;
+
     /* 
      * Initialization of the camera.
      * If your device is not in dev0, you'll have to change to the correct one.
      */
     cv::VideoCapture camera(0); 
     if(!camera.isOpened()) { 
-        std::cout << "Failed to connect to the camera" << std::endl;
+        std::cerr << "Failed to connect to the camera" << std::endl;
         return -1;
     }
     /*
-     * Create a window to see the result of the 
-     * face detection in the pictures that we are taking.
-     * And initialization of the matrix where we are
-     * going to save the images of the camera
+     * Construct the platform info setting the hostname/IP, port and authentication token.
+     * Every thread of the runtime creates its own cloud controller from it.
      */
-    cv::namedWindow("Face detection", cv::WINDOW_AUTOSIZE);
-    cv::Mat frame;
+    rapp::cloud::platform info = {"rapp.ee.auth.gr", "9001", "rapp_token"}; 
 
     /*
-     * Construct the platform info setting the hostname/IP, port and authentication token
-     * Then proceed to create a cloud controller.
-     * We'll use this object to create cloud calls to the platform.
+     * Faces are a small part of the frame. An LBP face cascade, run on a
+     * half resolution copy of the frame, finds where they may be and only
+     * that crop is uploaded; the platform does the real detection.
+     * If the cascade of OpenCV is somewhere else, change the path:
+     * without it the frames are sent whole.
      */
-    rapp::cloud::platform info = {"rapp.ee.auth.gr", "9001", "rapp_token"}; 
-    rapp::cloud::service_controller ctrl(info);
+    pipeline::cascade_roi cascade("/usr/share/opencv/lbpcascades/lbpcascade_frontalface.xml");
+
+    pipeline::runtime_settings settings;
+    settings.detector = cascade.loaded() ? &cascade : nullptr;
 
     /*
-     * Construct a lambda, std::function or bind your own functor.
-     * In this example we'll pass an inline lambda as the callback.
-     * All it does is to show how many faces have been found and 
-     * show a rectangle in the picture where is that face.
+     * Frames in one call. With more than 1, the batcher waits up to
+     * `max_wait` for them and tiles them in a mosaic, which is sent
+     * as one picture: fewer calls per frame, but more latency.
+     * With 1 every frame is sent on its own.
      */
-    auto callback = [&](std::vector<rapp::object::face> faces) { 
-        std::cout << "Found: " << faces.size() << " faces" << std::endl; 
-        for(auto each_face : faces) {
-            cv::rectangle(frame,
-                          cv::Point(each_face.get_left_x(), each_face.get_left_y()),
-                          cv::Point(each_face.get_right_x(), each_face.get_right_x()),
-                          cv::Scalar(255,0,0),
-                          1, 8, 0);
-        }
-    };
+    settings.batch.size = 1;
+    settings.batch.max_wait = boost::chrono::milliseconds(200);
 
     /*
-     * We create a variable chrono to count the time.
-     * It's going to be used for making the call every
-     * 500 ms. If we don't do it, we could block the platform.
-     * Other way, if you don't use the windows interface, it's to 
-     * make the call like the `loop.cpp` example.
+     * The rate controller decides how often we call the platform.
+     * It starts with a call every 500 ms and then follows the latency and
+     * the errors of the replies: it sends more calls while the platform
+     * replies fast and backs off as soon as it slows down, so we don't block it.
      */
-	auto before = std::chrono::system_clock::now();
+    settings.rate.start_rate = 2.0;
 
     /*
-     * Infinite loop until we press a key.
-     * All it does is every 500 ms is going to take the picture
-     * from the camera and create a picture object with this 
-     * image. After that we make the call to do the face detection
+     * Number of calls in flight at the same time. make_call waits for
+     * the reply, so the dispatcher overlaps the calls in a window:
+     * a bigger window hides more of the network, but loads the platform.
      */
-    for (;;) {
-		auto now = std::chrono::system_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - before).count(); 
+    settings.window = 2;
 
-		if (elapsed > 500) {
-			camera >> frame;
+    /*
+     * The results go to the sink, one JSON line per frame, with the
+     * number of the frame and the boxes (or the label) found in it.
+     */
+    pipeline::result_sink sink(output);
+
+    /*
+     * The overlay is lock-free for the display: the window never waits
+     * for a result. Between two replies it follows the faces with optical
+     * flow, so the boxes move with every frame of the camera.
+     */
+    pipeline::overlay faces_overlay(cv::Scalar(255, 0, 0), 1, pipeline::overlay::tracked);
+
+    /*
+     * Every 10 seconds print how long each stage takes (count, mean,
+     * p50, p99, p99.9 and max in ms), and once more when the program ends.
+     * The statistics go to std::clog, so the console output only has results.
+     */
+    pipeline::latency_reporter reporter(std::clog, boost::chrono::seconds(10));
 
-            std::vector<int> param = {{ CV_IMWRITE_PNG_COMPRESSION, 3 }};
-            cv::vector<uchar> buf;
-            cv::imencode(".png", frame, buf, param);
-            std::vector<rapp::types::byte> bytes(buf.begin(), buf.end());
-            auto pic = rapp::object::picture(bytes);
+    /*
+     * The runtime of the library builds and starts the stages:
+     * camera -> upload -> cache -> uncached -> regions -> cropped -> batcher
+     *        -> batched -> scaler -> scaled -> encoders -> outgoing -> dispatcher
+     *        -> display -> screen (window, optional)
+     * The regions and the batcher are chosen at compile time, so the call,
+     * the boxes of the reply and their mapping back to every frame are
+     * inlined in one function.
+     * The frames are encoded with the default codec of the service:
+     * face detection doesn't need the colour nor a lossless image,
+     * so a grayscale JPEG is much smaller and faster to encode than a PNG.
+     * A webcam on a desk sees the same face in front of the same wall
+     * for minutes, so the cache keeps the result of the last 64 scenes:
+     * when a frame looks like one of them the result is given at once
+     * (`cached` is true) and nothing is sent.
+     * The results come on a thread of the runtime, so we don't draw
+     * in the window: we write them in the sink and publish them in the overlay.
+     * They are stopped in the reverse order when they go out of scope.
+     */
+    pipeline::service_runtime<rapp::cloud::face_detection,
+                              pipeline::roi_front<pipeline::batch_front<>>> runtime(camera, info,
+        [&](std::uint64_t seq, std::vector<pipeline::detection> found, bool cached) {
+            sink.write("face_detection", seq, found, cached);
+            faces_overlay.publish(seq, std::move(found));
+        }, settings);
 
-            before = now;
-            ctrl.make_call<rapp::cloud::face_detection>(pic, true, callback);
-            cv::imshow("Face detection", frame);
-		}
-		if (cv::waitKey(30) >= 0) {
-			break;
-		}
-        boost::this_thread::sleep(boost::posix_time::milliseconds(500));
+    /*
+     * The window is only one more consumer of the display queue: it shows
+     * the newest frame with the newest faces at most 15 times per second,
+     * from a thread of its own, and never makes the pipeline wait.
+     * Headless there is no window at all.
+     * This thread only waits for Ctrl+C, SIGTERM or a key in the window.
+     */
+    std::unique_ptr<pipeline::display_stage> screen;
+    if (!headless) {
+        screen.reset(new pipeline::display_stage({{"Face detection", [&](cv::Mat & image) {
+            pipeline::frame latest;
+            if (!runtime.display().try_pop_newest(latest)) {
+                return false;
+            }
+            image = faces_overlay.compose(latest);
+            return true;
+        }}}, stop));
     }
+    stop.wait();
+    screen.reset();
+    runtime.print(std::clog);
     return 0;
 }
@@ -18,103 +18,172 @@
 #include <rapp/cloud/vision_detection.hpp>
 #include <rapp/objects/picture.hpp>
 
-#include <boost/date_time/posix_time/posix_time.hpp>
-#include <boost/thread/thread.hpp> 
+#include <pipeline/display_stage.hpp>
+#include <pipeline/latency.hpp>
+#include <pipeline/overlay.hpp>
+#include <pipeline/result_sink.hpp>
+#include <pipeline/service_runtime.hpp>
+#include <pipeline/stop_signal.hpp>
 
 #include <functional>
 #include <iostream>
-#include <chrono>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <utility>
 
 /*
  * \brief Example of human_detection showing the result in
  *  a opencv interface.
  */
-int main()
+int main(int argc, char* argv[])
 {
+    /*
+     * `--headless` runs without any window, e.g. on a robot or a server,
+     * and `--output file` writes the results in that file instead of
+     * the console, one JSON line per frame.
+     */
+    bool headless = !pipeline::display_stage::available();
+    std::string output;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--headless") {
+            headless = true;
+        }
+        else if (arg == "--output" && i + 1 < argc) {
+            output = argv[++i];
+        }
+    }
+
+    /*
+     * Ctrl+C or SIGTERM stop the program, and the stages
+     * still stop in order when they go out of scope.
+     */
+    pipeline::stop_signal stop;
+
     /* 
      * Initialization of the camera.
      * If your device is not in dev0, you'll have to change to the correct one.
-     * And we configure the camera to have a resolution of 640x480.
-     * With less resolution the time of process is lower.
+     * The window shows the camera at its resolution (we ask for 1280x720):
+     * only the pictures uploaded are scaled down to the upload size of
+     * human detection, which the platform processes in less time, and the boxes
+     * are scaled back to the frame.
      */
     cv::VideoCapture camera(0); 
     if(!camera.isOpened()) { 
-        std::cout << "Failed to connect to the camera" << std::endl;
+        std::cerr << "Failed to connect to the camera" << std::endl;
         return -1;
     }
-    camera.set(CV_CAP_PROP_FRAME_WIDTH,640);
-    camera.set(CV_CAP_PROP_FRAME_HEIGHT,480);
+    camera.set(CV_CAP_PROP_FRAME_WIDTH,1280);
+    camera.set(CV_CAP_PROP_FRAME_HEIGHT,720);
 
     /*
-     * Create a window to see the result of the 
-     * face detection in the pictures that we are taking.
-     * And initialization of the matrix where we are
-     * going to save the images of the camera
+     * Construct the platform info setting the hostname/IP, port and authentication token.
+     * Every thread of the runtime creates its own cloud controller from it.
      */
-    cv::namedWindow("Human detection", cv::WINDOW_AUTOSIZE);
-    cv::Mat frame;
+    rapp::cloud::platform info = {"rapp.ee.auth.gr", "9001", "rapp_token"}; 
 
     /*
-     * Construct the platform info setting the hostname/IP, port and authentication token
-     * Then proceed to create a cloud controller.
-     * We'll use this object to create cloud calls to the platform.
+     * People walking in front of the camera move: the motion detector
+     * finds the part of the frame which has changed and only that crop is
+     * uploaded. A frame with no motion is sent whole every now and then,
+     * so a person standing still is found too.
      */
-    rapp::cloud::platform info = {"rapp.ee.auth.gr", "9001", "rapp_token"}; 
-    rapp::cloud::service_controller ctrl(info);
+    pipeline::motion_roi motion;
+
+    pipeline::runtime_settings settings;
+    settings.detector = &motion;
 
     /*
-     * Construct a lambda, std::function or bind your own functor.
-     * In this example we'll pass an inline lambda as the callback.
-     * All it does is to show how many faces have been found and 
-     * show a rectangle in the picture where is that face.
+     * Frames in one call. With more than 1, the batcher waits up to
+     * `max_wait` for them and tiles them in a mosaic, which is sent
+     * as one picture: fewer calls per frame, but more latency.
+     * With 1 every frame is sent on its own.
      */
-    auto callback = [&](std::vector<rapp::object::human> humans) { 
-        std::cout << "Found " << humans.size() << " humans" << std::endl;
-        for(auto each_human : humans) {
-            cv::rectangle(frame,
-                          cv::Point(each_human.get_left_x(), each_human.get_left_y()),
-                          cv::Point(each_human.get_right_x(), each_human.get_right_x()),
-                          cv::Scalar(0, 255, 0),
-                          2, 8, 0);
-        }
-    };
+    settings.batch.size = 1;
+    settings.batch.max_wait = boost::chrono::milliseconds(200);
+
+    /*
+     * The rate controller decides how often we call the platform.
+     * It starts with a call every 300 ms and then follows the latency and
+     * the errors of the replies: it sends more calls while the platform
+     * replies fast and backs off as soon as it slows down, so we don't block it.
+     */
+    settings.rate.start_rate = 3.0;
+
+    /*
+     * Number of calls in flight at the same time. make_call waits for
+     * the reply, so the dispatcher overlaps the calls in a window:
+     * a bigger window hides more of the network, but loads the platform.
+     */
+    settings.window = 2;
+
+    /*
+     * The results go to the sink, one JSON line per frame, with the
+     * number of the frame and the boxes (or the label) found in it.
+     */
+    pipeline::result_sink sink(output);
+
+    /*
+     * The overlay is lock-free for the display: the window never waits
+     * for a result. Between two replies it follows the humans with optical
+     * flow, so the boxes move with every frame of the camera.
+     */
+    pipeline::overlay humans_overlay(cv::Scalar(0, 255, 0), 2, pipeline::overlay::tracked);
+
+    /*
+     * Every 10 seconds print how long each stage takes (count, mean,
+     * p50, p99, p99.9 and max in ms), and once more when the program ends.
+     * The statistics go to std::clog, so the console output only has results.
+     */
+    pipeline::latency_reporter reporter(std::clog, boost::chrono::seconds(10));
 
     /*
-     * We create a variable chrono to count the time.
-     * It's going to be used for making the call every
-     * 300 ms. If we don't do it, we could block the platform.
-     * Other way, if you don't use the windows interface, it's to 
-     * make the call like the `loop.cpp` example.
+     * The runtime of the library builds and starts the stages:
+     * camera -> upload -> cache -> uncached -> regions -> cropped -> batcher
+     *        -> batched -> scaler -> scaled -> encoders -> outgoing -> dispatcher
+     *        -> display -> screen (window, optional)
+     * The regions and the batcher are chosen at compile time, so the call,
+     * the boxes of the reply and their mapping back to every frame are
+     * inlined in one function.
+     * The frames are encoded with the default codec of the service:
+     * human detection doesn't need the colour nor a lossless image,
+     * so a grayscale JPEG is much smaller and faster to encode than a PNG.
+     * A webcam watching a room sees it empty, or the same people sitting
+     * still, for long stretches, so the cache keeps the result of the
+     * last 64 scenes: when a frame looks like one of them the result is
+     * given at once (`cached` is true) and nothing is sent.
+     * The results come on a thread of the runtime, so we don't draw
+     * in the window: we write them in the sink and publish them in the overlay.
+     * They are stopped in the reverse order when they go out of scope.
      */
-	auto before = std::chrono::system_clock::now();
+    pipeline::service_runtime<rapp::cloud::human_detection,
+                              pipeline::roi_front<pipeline::batch_front<>>> runtime(camera, info,
+        [&](std::uint64_t seq, std::vector<pipeline::detection> found, bool cached) {
+            sink.write("human_detection", seq, found, cached);
+            humans_overlay.publish(seq, std::move(found));
+        }, settings);
 
     /*
-     * Infinite loop until we press a key.
-     * All it does is every 500 ms is going to take the picture
-     * from the camera and create a picture object with this 
-     * image. After that we make the call to do the face detection
+     * The window is only one more consumer of the display queue: it shows
+     * the newest frame with the newest humans at most 15 times per second,
+     * from a thread of its own, and never makes the pipeline wait.
+     * Headless there is no window at all.
+     * This thread only waits for Ctrl+C, SIGTERM or a key in the window.
      */
-    for (;;) {
-		auto now = std::chrono::system_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - before).count(); 
-
-		if (elapsed > 300) {
-			camera >> frame;
-
-            std::vector<int> param = {{ CV_IMWRITE_PNG_COMPRESSION, 3 }};
-            cv::vector<uchar> buf;
-            cv::imencode(".png", frame, buf, param);
-            std::vector<rapp::types::byte> bytes(buf.begin(), buf.end());
-            auto pic = rapp::object::picture(bytes);
-
-            before = now;
-            ctrl.make_call<rapp::cloud::human_detection>(pic, callback);
-            cv::imshow("Human detection", frame);
-		}
-		if (cv::waitKey(30) >= 0) {
-			break;
-		}
-        //boost::this_thread::sleep(boost::posix_time::milliseconds(300));
+    std::unique_ptr<pipeline::display_stage> screen;
+    if (!headless) {
+        screen.reset(new pipeline::display_stage({{"Human detection", [&](cv::Mat & image) {
+            pipeline::frame latest;
+            if (!runtime.display().try_pop_newest(latest)) {
+                return false;
+            }
+            image = humans_overlay.compose(latest);
+            return true;
+        }}}, stop));
     }
+    stop.wait();
+    screen.reset();
+    runtime.print(std::clog);
     return 0;
 }
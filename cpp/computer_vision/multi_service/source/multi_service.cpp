@@ -0,0 +1,242 @@
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <opencv2/opencv.hpp>
+#include <rapp/cloud/service_controller.hpp>
+#include <rapp/cloud/vision_detection.hpp>
+#include <rapp/cloud/vision_recognition.hpp>
+#include <rapp/objects/picture.hpp>
+
+#include <pipeline/bounded_queue.hpp>
+#include <pipeline/capture_stage.hpp>
+#include <pipeline/change_detector.hpp>
+#include <pipeline/codec.hpp>
+#include <pipeline/display_stage.hpp>
+#include <pipeline/encode_pool.hpp>
+#include <pipeline/fanout_dispatcher.hpp>
+#include <pipeline/latency.hpp>
+#include <pipeline/overlay.hpp>
+#include <pipeline/rate_controller.hpp>
+#include <pipeline/result_sink.hpp>
+#include <pipeline/stop_signal.hpp>
+
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * \brief Example which sends every frame to several services of the platform:
+ *  the frame is captured and encoded once, and the results are merged.
+ *  Usage: multi_service [face] [human] [object] [--headless] [--output file],
+ *  all the services by default.
+ */
+int main(int argc, char* argv[])
+{
+    /*
+     * The services that we want. Every one makes its call with the
+     * controller and the picture it receives, and adds what it found
+     * to the detections of the frame.
+     * We pass the picture with std::cref, otherwise make_call would copy it.
+     */
+    pipeline::service face = {"face", [](rapp::cloud::service_controller & ctrl,
+                                         const rapp::object::picture & pic,
+                                         std::vector<pipeline::detection> & found) {
+        bool replied = false;
+        auto callback = [&](std::vector<rapp::object::face> faces) {
+            replied = true;
+            for (auto & each : pipeline::boxes(faces)) {
+                each.label = "face";
+                found.push_back(each);
+            }
+        };
+        ctrl.make_call<rapp::cloud::face_detection>(std::cref(pic), true, callback);
+        return replied;
+    }};
+    pipeline::service human = {"human", [](rapp::cloud::service_controller & ctrl,
+                                           const rapp::object::picture & pic,
+                                           std::vector<pipeline::detection> & found) {
+        bool replied = false;
+        auto callback = [&](std::vector<rapp::object::human> humans) {
+            replied = true;
+            for (auto & each : pipeline::boxes(humans)) {
+                each.label = "human";
+                found.push_back(each);
+            }
+        };
+        ctrl.make_call<rapp::cloud::human_detection>(std::cref(pic), callback);
+        return replied;
+    }};
+    pipeline::service object = {"object", [](rapp::cloud::service_controller & ctrl,
+                                             const rapp::object::picture & pic,
+                                             std::vector<pipeline::detection> & found) {
+        bool replied = false;
+        auto callback = [&](std::string objects) {
+            replied = true;
+            if (!objects.empty()) {
+                found.push_back({cv::Rect(), objects});
+            }
+        };
+        ctrl.make_call<rapp::cloud::object_recognition>(std::cref(pic), callback);
+        return replied;
+    }};
+
+    /*
+     * `--headless` runs without any window, e.g. on a robot or a server,
+     * and `--output file` writes the results in that file instead of
+     * the console, one JSON line per frame.
+     */
+    bool headless = !pipeline::display_stage::available();
+    std::string output;
+    std::vector<pipeline::service> services;
+    for (int i = 1; i < argc; ++i) {
+        const std::string name = argv[i];
+        if (name == "--headless") {
+            headless = true;
+        }
+        else if (name == "--output" && i + 1 < argc) {
+            output = argv[++i];
+        }
+        for (const auto & each : {face, human, object}) {
+            if (each.name == name) {
+                services.push_back(each);
+            }
+        }
+    }
+    if (services.empty()) {
+        services = {face, human, object};
+    }
+
+    /*
+     * The frame is encoded once for all the services, so the codec has to
+     * suit all of them: object recognition needs the colour, face and
+     * human detection are happy with a grayscale JPEG.
+     */
+    pipeline::codec format = pipeline::default_codec<rapp::cloud::face_detection>::get();
+    for (const auto & each : services) {
+        if (each.name == "object") {
+            format = pipeline::default_codec<rapp::cloud::object_recognition>::get();
+        }
+    }
+    std::clog << "Services:";
+    for (const auto & each : services) {
+        std::clog << " " << each.name;
+    }
+    std::clog << ", sent as " << format.name() << std::endl;
+
+    /* 
+     * Initialization of the camera, only once for all the services.
+     * If your device is not in dev0, you'll have to change to the correct one.
+     */
+    cv::VideoCapture camera(0); 
+    if(!camera.isOpened()) { 
+        std::cerr << "Failed to connect to the camera" << std::endl;
+        return -1;
+    }
+    camera.set(CV_CAP_PROP_FRAME_WIDTH,640);
+    camera.set(CV_CAP_PROP_FRAME_HEIGHT,480);
+
+    rapp::cloud::platform info = {"rapp.ee.auth.gr", "9001", "rapp_token"}; 
+
+    /*
+     * Ctrl+C or SIGTERM stop the program, and the stages
+     * still stop in order when they go out of scope.
+     */
+    pipeline::stop_signal stop;
+
+    /*
+     * The stages of the pipeline are joined by bounded queues:
+     * camera -> upload -> encoders -> outgoing -> dispatcher -> every service
+     *        -> display -> screen (window, optional)
+     * The upload queue is a mailbox which only keeps the latest frame,
+     * and an encoded frame older than a second is dropped rather than sent.
+     */
+    pipeline::bounded_queue<pipeline::frame> upload(1);
+    pipeline::bounded_queue<pipeline::frame> display(2);
+    pipeline::bounded_queue<pipeline::encoded_frame> outgoing(4);
+    pipeline::drop_older_than(outgoing, boost::chrono::seconds(1));
+
+    /*
+     * When all the services of a frame have replied, the dispatcher gives
+     * us what they found together: we write it in the sink, one JSON line
+     * per frame, and publish it in the overlay.
+     */
+    pipeline::result_sink sink(output);
+    pipeline::overlay results(cv::Scalar(255, 0, 255), 2, pipeline::overlay::tracked);
+    auto merged = [&](std::uint64_t seq, std::vector<pipeline::detection> found) {
+        sink.write("multi_service", seq, found);
+        results.publish(seq, std::move(found));
+    };
+
+    /*
+     * The rate controller sees one call per frame, as long as the
+     * slowest service, so it doesn't send more frames than the
+     * slowest service can take.
+     */
+    pipeline::rate_settings settings;
+    settings.start_rate = 2.0;
+    pipeline::rate_controller rate(settings);
+    pipeline::change_detector changes;
+
+    /*
+     * The camera reads into 8 images which are used again once the
+     * queues, the encoders and the window are done with them.
+     */
+    pipeline::frame_pool frames(8);
+
+    /*
+     * Every 10 seconds print how long each stage takes (count, mean,
+     * p50, p99, p99.9 and max in ms), and once more when the program ends.
+     * The statistics go to std::clog, so the console output only has results.
+     */
+    pipeline::latency_reporter reporter(std::clog, boost::chrono::seconds(10));
+
+    /*
+     * Start the stages from the last one to the first one.
+     * They are stopped in the reverse order when they go out of scope.
+     * Up to 2 frames are in flight, so up to 2 calls per service.
+     */
+    pipeline::fanout_dispatcher dispatcher(info, outgoing, 2, rate, services, merged);
+    pipeline::encode_pool encoders(upload, outgoing, 2, format);
+    pipeline::capture_stage capture(camera, upload, display, rate, &changes, &frames);
+
+    /*
+     * The window is only one more consumer of the display queue: it shows
+     * the newest frame with the newest results at most 15 times per second,
+     * from a thread of its own, and never makes the pipeline wait.
+     * Headless there is no window at all.
+     * This thread only waits for Ctrl+C, SIGTERM or a key in the window.
+     */
+    std::unique_ptr<pipeline::display_stage> screen;
+    if (!headless) {
+        screen.reset(new pipeline::display_stage({{"Multi service", [&](cv::Mat & image) {
+            pipeline::frame latest;
+            if (!display.try_pop_newest(latest)) {
+                return false;
+            }
+            image = results.compose(latest);
+            return true;
+        }}}, stop));
+    }
+    stop.wait();
+    screen.reset();
+    std::clog << "Frames: " << capture.captured() << " captured, " << changes.skipped() << " unchanged, "
+              << upload.dropped() + outgoing.dropped() << " dropped (" << outgoing.stale() << " too old)" << std::endl;
+    dispatcher.controllers().print(std::clog);
+    return 0;
+}
@@ -0,0 +1,171 @@
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <opencv2/opencv.hpp>
+#include <rapp/cloud/service_controller.hpp>
+#include <rapp/cloud/vision_detection.hpp>
+#include <rapp/objects/picture.hpp>
+
+#include <pipeline/codec.hpp>
+#include <pipeline/display_stage.hpp>
+#include <pipeline/fleet_dispatcher.hpp>
+#include <pipeline/frame_source.hpp>
+#include <pipeline/latency.hpp>
+#include <pipeline/overlay.hpp>
+#include <pipeline/replay_camera.hpp>
+#include <pipeline/result_sink.hpp>
+#include <pipeline/stop_signal.hpp>
+#include <pipeline/usb_camera.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * \brief Example of face detection with many cameras in one process.
+ *  Usage: multi_source usb:0 usb:1 replay:frames_folder ... [--headless] [--output file]
+ */
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        std::cerr << "Usage 'multi_source usb:device | replay:folder ... [--headless] [--output file]'" << std::endl;
+        return 1;
+    }
+
+    /*
+     * Every source is a pipeline::frame_source which keeps its newest frame:
+     * a usb camera, or recorded frames. On NAO, pipeline::nao_camera is a
+     * frame_source too, so robots are added in the same way.
+     * `--headless` runs without any window, and `--output file` writes
+     * the results in that file instead of the console.
+     */
+    bool headless = !pipeline::display_stage::available();
+    std::string output;
+    std::vector<std::unique_ptr<pipeline::frame_source>> sources;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--headless") {
+            headless = true;
+        }
+        else if (arg == "--output" && i + 1 < argc) {
+            output = argv[++i];
+        }
+        else if (arg.compare(0, 4, "usb:") == 0) {
+            auto camera = new pipeline::usb_camera(std::atoi(arg.c_str() + 4));
+            sources.emplace_back(camera);
+            if (!camera->opened()) {
+                std::cerr << "Failed to connect to the camera " << arg << std::endl;
+                return -1;
+            }
+        }
+        else if (arg.compare(0, 7, "replay:") == 0) {
+            sources.emplace_back(new pipeline::replay_camera(arg.substr(7)));
+        }
+        else {
+            std::cerr << "Unknown source " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    /*
+     * Every source has its own overlay, in its own window.
+     */
+    std::vector<std::unique_ptr<pipeline::overlay>> overlays;
+    std::vector<pipeline::frame_source*> fleet;
+    for (const auto & each : sources) {
+        overlays.emplace_back(new pipeline::overlay(cv::Scalar(255, 0, 0), 1, pipeline::overlay::tracked));
+        fleet.push_back(each.get());
+    }
+
+    /*
+     * Ctrl+C or SIGTERM stop the program, and the dispatcher
+     * still stops in order when it goes out of scope.
+     */
+    pipeline::stop_signal stop;
+
+    /*
+     * The call gets the index of the source and the number of its frame,
+     * so the faces go to the overlay of the right source, and to the sink
+     * as one JSON line per frame.
+     * We pass the picture with std::cref, otherwise make_call would copy it.
+     */
+    pipeline::result_sink sink(output);
+    auto call = [&](rapp::cloud::service_controller & ctrl,
+                    const rapp::object::picture & pic,
+                    std::size_t source,
+                    const pipeline::frame & shot) {
+        bool replied = false;
+        auto callback = [&](std::vector<rapp::object::face> faces) {
+            replied = true;
+            auto found = pipeline::boxes(faces);
+            sink.write("source_" + std::to_string(source), shot.seq, found);
+            overlays[source]->publish(shot.seq, std::move(found));
+        };
+        ctrl.make_call<rapp::cloud::face_detection>(std::cref(pic), true, callback);
+        return replied;
+    };
+
+    /*
+     * Every 10 seconds print how long each stage takes (count, mean,
+     * p50, p99, p99.9 and max in ms), and once more when the program ends.
+     * The statistics go to std::clog, so the console output only has results.
+     */
+    pipeline::latency_reporter reporter(std::clog, boost::chrono::seconds(10));
+
+    /*
+     * One dispatcher serves all the sources with a worker per core.
+     * Every source has its own rate controller and change detector and
+     * never more than one call in flight, so a slow source slows down
+     * only itself.
+     */
+    rapp::cloud::platform info = {"rapp.ee.auth.gr", "9001", "rapp_token"}; 
+    pipeline::fleet_settings settings;
+    settings.rate.start_rate = 2.0;
+    pipeline::fleet_dispatcher dispatcher(info, fleet,
+                                          pipeline::default_codec<rapp::cloud::face_detection>::get(),
+                                          call, settings);
+
+    /*
+     * The windows are optional: the display shows the newest frame of
+     * every source at most 15 times per second, from a thread of its own.
+     * This thread only waits for Ctrl+C, SIGTERM or a key in a window.
+     */
+    std::unique_ptr<pipeline::display_stage> screen;
+    if (!headless) {
+        std::vector<pipeline::view> views;
+        for (std::size_t i = 0; i < sources.size(); ++i) {
+            auto shown = std::make_shared<std::uint64_t>(UINT64_MAX);
+            views.push_back({"Source " + std::to_string(i), [&, i, shown](cv::Mat & image) {
+                pipeline::frame latest;
+                if (!sources[i]->latest(latest) || latest.seq == *shown) {
+                    return false;
+                }
+                *shown = latest.seq;
+                image = overlays[i]->compose(latest);
+                return true;
+            }});
+        }
+        screen.reset(new pipeline::display_stage(views, stop));
+    }
+    stop.wait();
+    screen.reset();
+    dispatcher.print(std::clog);
+    dispatcher.controllers().print(std::clog);
+    return 0;
+}
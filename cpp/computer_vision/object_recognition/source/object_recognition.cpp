@@ -18,101 +18,151 @@
 #include <rapp/cloud/vision_recognition.hpp>
 #include <rapp/objects/picture.hpp>
 
-#include <boost/date_time/posix_time/posix_time.hpp>
-#include <boost/thread/thread.hpp> 
+#include <pipeline/display_stage.hpp>
+#include <pipeline/latency.hpp>
+#include <pipeline/overlay.hpp>
+#include <pipeline/result_sink.hpp>
+#include <pipeline/service_runtime.hpp>
+#include <pipeline/stop_signal.hpp>
 
 #include <functional>
 #include <iostream>
-#include <chrono>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <utility>
 
 /*
  * \brief Example of object_recognition showing the result in
  *  a opencv interface.
  */
-int main()
+int main(int argc, char* argv[])
 {
+    /*
+     * `--headless` runs without any window, e.g. on a robot or a server,
+     * and `--output file` writes the results in that file instead of
+     * the console, one JSON line per frame.
+     */
+    bool headless = !pipeline::display_stage::available();
+    std::string output;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--headless") {
+            headless = true;
+        }
+        else if (arg == "--output" && i + 1 < argc) {
+            output = argv[++i];
+        }
+    }
+
+    /*
+     * Ctrl+C or SIGTERM stop the program, and the stages
+     * still stop in order when they go out of scope.
+     */
+    pipeline::stop_signal stop;
+
     /* 
      * Initialization of the camera.
      * If your device is not in dev0, you'll have to change to the correct one.
-     * And we configure the camera to have a resolution of 640x480.
-     * With less resolution the time of process is lower.
+     * The window shows the camera at its resolution (we ask for 1280x720):
+     * only the pictures uploaded are scaled down to the upload size of
+     * object recognition, which the platform processes in less time.
+     * The reply is only a label, so there is nothing to scale back.
      */
     cv::VideoCapture camera(0); 
     if(!camera.isOpened()) { 
-        std::cout << "Failed to connect to the camera" << std::endl;
+        std::cerr << "Failed to connect to the camera" << std::endl;
         return -1;
     }
-    camera.set(CV_CAP_PROP_FRAME_WIDTH,640);
-    camera.set(CV_CAP_PROP_FRAME_HEIGHT,480);
+    camera.set(CV_CAP_PROP_FRAME_WIDTH,1280);
+    camera.set(CV_CAP_PROP_FRAME_HEIGHT,720);
 
     /*
-     * Create a window to see the result of the 
-     * face detection in the pictures that we are taking.
-     * And initialization of the matrix where we are
-     * going to save the images of the camera
+     * Construct the platform info setting the hostname/IP, port and authentication token.
+     * Every thread of the runtime creates its own cloud controller from it.
      */
-    cv::namedWindow("Object recognition", cv::WINDOW_AUTOSIZE);
-    cv::Mat frame;
+    rapp::cloud::platform info = {"155.207.19.229", "9001", "rapp_token"}; 
+
+    pipeline::runtime_settings settings;
 
     /*
-     * Construct the platform info setting the hostname/IP, port and authentication token
-     * Then proceed to create a cloud controller.
-     * We'll use this object to create cloud calls to the platform.
+     * The rate controller decides how often we call the platform.
+     * It starts with a call every 300 ms and then follows the latency and
+     * the errors of the replies: it sends more calls while the platform
+     * replies fast and backs off as soon as it slows down, so we don't block it.
      */
-    rapp::cloud::platform info = {"155.207.19.229", "9001", "rapp_token"}; 
-    rapp::cloud::service_controller ctrl(info);
+    settings.rate.start_rate = 3.0;
 
     /*
-     * Construct a lambda, std::function or bind your own functor.
-     * In this example we'll pass an inline lambda as the callback.
-     * All it does is to show if it has found any object and 
-     * show in the window what object is.
+     * Number of calls in flight at the same time. make_call waits for
+     * the reply, so the dispatcher overlaps the calls in a window:
+     * a bigger window hides more of the network, but loads the platform.
      */
-    auto callback = [&](std::string objects) { 
-        if (objects.empty()) {
-            std::cout << "No objects found" << std::endl;
-        }
-        else {
-            std::cout << "Found " << objects << std::endl;
-            cv::putText(frame, objects, cv::Point(50,50), cv::FONT_HERSHEY_PLAIN, 2, cv::Scalar(0, 0, 255), 2);
-        }
-    };
+    settings.window = 2;
 
     /*
-     * We create a variable chrono to count the time.
-     * It's going to be used for making the call every
-     * 300 ms. If we don't do it, we could block the platform.
-     * Other way, if you don't use the windows interface, it's to 
-     * make the call like the `loop.cpp` example.
+     * The results go to the sink, one JSON line per frame, with the
+     * number of the frame and the boxes (or the label) found in it.
      */
-	auto before = std::chrono::system_clock::now();
+    pipeline::result_sink sink(output);
 
     /*
-     * Infinite loop until we press a key.
-     * All it does is every 500 ms is going to take the picture
-     * from the camera and create a picture object with this 
-     * image. After that we make the call to do the face detection
+     * The overlay is lock-free for the display: the window never waits
+     * for a result. It writes the name of the object on the frame.
      */
-    for (;;) {
-		auto now = std::chrono::system_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - before).count(); 
+    pipeline::overlay objects_overlay(cv::Scalar(0, 0, 255), 2);
 
-		if (elapsed > 300) {
-			camera >> frame;
+    /*
+     * Every 10 seconds print how long each stage takes (count, mean,
+     * p50, p99, p99.9 and max in ms), and once more when the program ends.
+     * The statistics go to std::clog, so the console output only has results.
+     */
+    pipeline::latency_reporter reporter(std::clog, boost::chrono::seconds(10));
 
-            std::vector<int> param = {{ CV_IMWRITE_PNG_COMPRESSION, 3 }};
-            cv::vector<uchar> buf;
-            cv::imencode(".png", frame, buf, param);
-            std::vector<rapp::types::byte> bytes(buf.begin(), buf.end());
-            auto pic = rapp::object::picture(bytes);
+    /*
+     * The runtime of the library builds and starts the stages:
+     * camera -> upload -> cache -> uncached -> scaler -> scaled -> encoders
+     *        -> outgoing -> dispatcher
+     *        -> display -> screen (window, optional)
+     * The service is chosen at compile time, so the call and the
+     * conversion of the reply are inlined in one function.
+     * The frames are encoded with the default codec of the service:
+     * object recognition keeps the colour, in a JPEG which is much
+     * smaller and faster to encode than a PNG.
+     * The same objects come back in front of the webcam again and again
+     * (the mug on the desk, the book in your hand), so the cache keeps
+     * the result of the last 64 scenes: when a frame looks like one of them
+     * the result is given at once (`cached` is true) and nothing is sent.
+     * The results come on a thread of the runtime, so we don't draw
+     * in the window: we write them in the sink and publish them in the overlay.
+     * They are stopped in the reverse order when they go out of scope.
+     */
+    pipeline::service_runtime<rapp::cloud::object_recognition> runtime(camera, info,
+        [&](std::uint64_t seq, std::vector<pipeline::detection> found, bool cached) {
+            sink.write("object_recognition", seq, found, cached);
+            objects_overlay.publish(seq, std::move(found));
+        }, settings);
 
-            before = now;
-            ctrl.make_call<rapp::cloud::object_recognition>(pic, callback);
-            cv::imshow("Object recognition", frame);
-		}
-		if (cv::waitKey(30) >= 0) {
-			break;
-		}
+    /*
+     * The window is only one more consumer of the display queue: it shows
+     * the newest frame with the newest objects at most 15 times per second,
+     * from a thread of its own, and never makes the pipeline wait.
+     * Headless there is no window at all.
+     * This thread only waits for Ctrl+C, SIGTERM or a key in the window.
+     */
+    std::unique_ptr<pipeline::display_stage> screen;
+    if (!headless) {
+        screen.reset(new pipeline::display_stage({{"Object recognition", [&](cv::Mat & image) {
+            pipeline::frame latest;
+            if (!runtime.display().try_pop_newest(latest)) {
+                return false;
+            }
+            image = objects_overlay.compose(latest);
+            return true;
+        }}}, stop));
     }
+    stop.wait();
+    screen.reset();
+    runtime.print(std::clog);
     return 0;
 }
@@ -0,0 +1,389 @@
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <opencv2/opencv.hpp>
+#include <rapp/cloud/service_controller.hpp>
+#include <rapp/cloud/vision_detection.hpp>
+#include <rapp/objects/picture.hpp>
+
+#include <pipeline/allocation_site.hpp>
+#include <pipeline/clock.hpp>
+#include <pipeline/latency.hpp>
+#include <pipeline/overlay.hpp>
+#include <pipeline/replay_capture.hpp>
+#include <pipeline/service_runtime.hpp>
+#include <pipeline/stand_in_platform.hpp>
+
+#include <boost/chrono.hpp>
+#include <boost/chrono/process_cpu_clocks.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <utility>
+
+/*
+ * The allocations are counted by the site of the thread which makes them
+ * (pipeline::allocation_site), at the level of malloc: operator new, the
+ * images of OpenCV (fastMalloc) and the C libraries all end there. The
+ * stages of the frame path, from the camera to the encoders, must make
+ * none once the pipeline is warm (the frame pools, the queues, the rings
+ * and the scratch of the stages make the frames cost none). What OpenCV
+ * allocates inside its image functions and the codec are counted apart,
+ * per frame, and the rest of the program (the results, the calls,
+ * librapp, the stand-in platform, the overlay) not at all.
+ * With another C library than glibc only operator new is counted.
+ */
+static std::atomic<std::uint64_t> allocations[4];
+
+static std::uint64_t allocations_at(pipeline::allocation_site site)
+{
+    return allocations[static_cast<int>(site)];
+}
+
+static void count_allocation()
+{
+    allocations[static_cast<int>(pipeline::current_allocation_site())].fetch_add(1, std::memory_order_relaxed);
+}
+
+#if defined(__GLIBC__)
+extern "C" {
+
+void * __libc_malloc(std::size_t size);
+void * __libc_calloc(std::size_t count, std::size_t size);
+void * __libc_realloc(void * p, std::size_t size);
+void * __libc_memalign(std::size_t alignment, std::size_t size);
+void __libc_free(void * p);
+
+void * malloc(std::size_t size) noexcept
+{
+    count_allocation();
+    return __libc_malloc(size);
+}
+
+void * calloc(std::size_t count, std::size_t size) noexcept
+{
+    count_allocation();
+    return __libc_calloc(count, size);
+}
+
+void * realloc(void * p, std::size_t size) noexcept
+{
+    count_allocation();
+    return __libc_realloc(p, size);
+}
+
+void * memalign(std::size_t alignment, std::size_t size) noexcept
+{
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+void * aligned_alloc(std::size_t alignment, std::size_t size) noexcept
+{
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void ** p, std::size_t alignment, std::size_t size) noexcept
+{
+    count_allocation();
+    *p = __libc_memalign(alignment, size);
+    return *p ? 0 : ENOMEM;
+}
+
+void free(void * p) noexcept
+{
+    __libc_free(p);
+}
+
+}
+#else
+void * operator new(std::size_t size)
+{
+    count_allocation();
+    if (void * p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void * operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void * p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void * p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void * p, std::size_t) noexcept
+{
+    std::free(p);
+}
+#endif
+
+/// \brief CPU time of the whole process, user and system
+static boost::chrono::nanoseconds cpu_time()
+{
+    return boost::chrono::process_user_cpu_clock::now().time_since_epoch()
+           + boost::chrono::process_system_cpu_clock::now().time_since_epoch();
+}
+
+/*
+ * \brief Replays recorded frames through the pipeline of the face
+ *  detection tutorial against a local stand-in of the platform, and
+ *  reports the throughput, the latency, the bytes and the CPU per frame.
+ */
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        std::cerr << "Usage 'pipeline_benchmark frames_folder_or_video [--fps 30] [--loops 1]"
+                     " [--latency ms] [--jitter ms] [--window 2] [--port 9001] [--json]'" << std::endl;
+        return 1;
+    }
+    double fps = 30;
+    std::size_t loops = 1;
+    unsigned int window = 2;
+    bool json = false;
+    pipeline::stand_in_settings platform_settings;
+    for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--fps" && has_value) {
+            fps = std::atof(argv[++i]);
+        }
+        else if (arg == "--loops" && has_value) {
+            loops = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--latency" && has_value) {
+            platform_settings.latency = boost::chrono::milliseconds(std::atoi(argv[++i]));
+        }
+        else if (arg == "--jitter" && has_value) {
+            platform_settings.jitter = boost::chrono::milliseconds(std::atoi(argv[++i]));
+        }
+        else if (arg == "--window" && has_value) {
+            window = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--port" && has_value) {
+            platform_settings.port = static_cast<unsigned short>(std::atoi(argv[++i]));
+        }
+        else if (arg == "--json") {
+            json = true;
+        }
+    }
+
+    /*
+     * The recorded frames replace the camera: they go through the same
+     * capture stage, at the rate of a camera.
+     */
+    pipeline::replay_capture camera(argv[1], fps, loops);
+    if (!camera.isOpened()) {
+        std::cerr << "No frames found in " << argv[1] << std::endl;
+        return 1;
+    }
+
+    /*
+     * The stand-in platform answers on this computer after the latency
+     * and the jitter we want, and counts the bytes it receives.
+     */
+    pipeline::stand_in_platform platform(platform_settings);
+    rapp::cloud::platform info = platform.info();
+
+    /*
+     * From here on, the same runtime as the face detection tutorial,
+     * without the window: the display frames are composed but not shown.
+     */
+    pipeline::cascade_roi cascade("/usr/share/opencv/lbpcascades/lbpcascade_frontalface.xml");
+    pipeline::runtime_settings settings;
+    settings.detector = cascade.loaded() ? &cascade : nullptr;
+    settings.batch.size = 1;
+    settings.rate.start_rate = 2.0;
+    settings.window = window;
+
+    pipeline::overlay faces_overlay(cv::Scalar(255, 0, 0), 1, pipeline::overlay::tracked);
+
+    /*
+     * The allocations and the misses of the frame pool are counted from
+     * the first second of frames (the pool and the encoders are warm by
+     * then) to the end of the replay.
+     */
+    struct snapshot
+    {
+        std::uint64_t frames = 0, frame_path = 0, opencv = 0, codec = 0, misses = 0;
+    };
+    const std::uint64_t warm_up = static_cast<std::uint64_t>(std::max(fps, 30.0));
+    snapshot warm, end;
+
+    // the stand-in platform runs in this process: its CPU time is left out
+    const auto cpu_start = cpu_time() - platform.cpu_time();
+    const auto start = pipeline::clock::now();
+    std::uint64_t composed = 0, started = 0, replies = 0, skipped = 0, hits = 0;
+    std::uint64_t leases = 0, misses = 0, dropped = 0, stale = 0, processed = 0;
+    std::ostringstream stages_print;
+    {
+        pipeline::service_runtime<rapp::cloud::face_detection,
+                                  pipeline::roi_front<pipeline::batch_front<>>> runtime(camera, info,
+            [&](std::uint64_t seq, std::vector<pipeline::detection> found, bool) {
+                faces_overlay.publish(seq, std::move(found));
+            }, settings);
+
+        /*
+         * Compose every frame like the window would, until the replay
+         * ends and the calls have been quiet for a second
+         * (or, if the platform doesn't answer, for a minute at most).
+         */
+        pipeline::frame latest;
+        const auto take_snapshot = [&](snapshot & at) {
+            at.frames = camera.delivered();
+            at.frame_path = allocations_at(pipeline::allocation_site::frame_path);
+            at.opencv = allocations_at(pipeline::allocation_site::opencv);
+            at.codec = allocations_at(pipeline::allocation_site::codec);
+            at.misses = runtime.frames().misses();
+        };
+        std::uint64_t last_started = 0;
+        auto quiet_since = pipeline::clock::now();
+        auto ended = pipeline::clock::time_point::max();
+        for (;;) {
+            if (warm.frames == 0 && camera.delivered() >= warm_up) {
+                take_snapshot(warm);
+            }
+            if (runtime.display().try_pop(latest)) {
+                faces_overlay.compose(latest);
+                ++composed;
+                continue;
+            }
+            const auto now = pipeline::clock::now();
+            if (runtime.calls() != last_started || runtime.calls() != runtime.completed()) {
+                last_started = runtime.calls();
+                quiet_since = now;
+            }
+            if (camera.finished()) {
+                if (ended == pipeline::clock::time_point::max()) {
+                    take_snapshot(end);
+                }
+                ended = std::min(ended, now);
+                if (now - quiet_since > boost::chrono::seconds(1) || now - ended > boost::chrono::minutes(1)) {
+                    break;
+                }
+            }
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(5));
+        }
+        started = runtime.calls();
+        replies = runtime.replies();
+        skipped = runtime.changes().skipped();
+        hits = runtime.cache().hits();
+        leases = runtime.frames().acquired();
+        misses = runtime.frames().misses();
+        dropped = runtime.dropped();
+        stale = runtime.stale();
+        processed = runtime.processed();
+        runtime.print(stages_print);
+    }
+    const double seconds = boost::chrono::duration<double>(pipeline::clock::now() - start).count();
+    const double cpu_ms = boost::chrono::duration<double, boost::milli>(cpu_time() - platform.cpu_time()
+                                                                        - cpu_start).count();
+
+    const double frames = static_cast<double>(camera.delivered());
+    const double calls = static_cast<double>(started);
+    const bool measured = warm.frames > 0 && end.frames > warm.frames;
+    const std::uint64_t steady_allocations = measured ? end.frame_path - warm.frame_path : 0;
+    const std::uint64_t steady_misses = measured ? end.misses - warm.misses : 0;
+    const double opencv_per_frame = measured ? static_cast<double>(end.opencv - warm.opencv) / (end.frames - warm.frames)
+                                             : 0;
+    const double codec_per_frame = measured ? static_cast<double>(end.codec - warm.codec) / (end.frames - warm.frames)
+                                            : 0;
+    // the frame path must not allocate once it is warm: a regression fails the run
+    const int status = steady_allocations == 0 && steady_misses == 0 ? 0 : 2;
+    const auto & end_to_end = pipeline::latency().get("capture_to_reply");
+    const auto & at_call = pipeline::latency().get("capture_to_call");
+    if (json) {
+        std::ostringstream stages;
+        pipeline::latency().print_json(stages);
+        std::cout << "{\"frames\":" << camera.delivered()
+                  << ",\"calls\":" << started
+                  << ",\"replies\":" << replies
+                  << ",\"dropped\":" << dropped
+                  << ",\"stale\":" << stale
+                  << ",\"processed\":" << processed
+                  << ",\"seconds\":" << seconds
+                  << ",\"frames_per_second\":" << frames / seconds
+                  << ",\"replies_per_second\":" << replies / seconds
+                  << ",\"p50_us\":" << end_to_end.percentile(0.5)
+                  << ",\"p99_us\":" << end_to_end.percentile(0.99)
+                  << ",\"p999_us\":" << end_to_end.percentile(0.999)
+                  << ",\"call_age_p50_us\":" << at_call.percentile(0.5)
+                  << ",\"call_age_p99_us\":" << at_call.percentile(0.99)
+                  << ",\"bytes\":" << platform.bytes()
+                  << ",\"bytes_per_call\":" << (calls > 0 ? platform.bytes() / calls : 0)
+                  << ",\"cpu_ms_per_frame\":" << cpu_ms / frames
+                  << ",\"frame_path_allocations\":" << steady_allocations
+                  << ",\"opencv_allocations_per_frame\":" << opencv_per_frame
+                  << ",\"codec_allocations_per_frame\":" << codec_per_frame
+                  << ",\"pool_leases\":" << leases
+                  << ",\"pool_misses\":" << misses
+                  << ",\"steady_pool_misses\":" << steady_misses
+                  << ",\"stages\":" << stages.str().substr(0, stages.str().find('\n')) << "}" << std::endl;
+        return status;
+    }
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "Frames:      " << camera.delivered() << " captured, " << composed << " composed, "
+              << skipped << " unchanged, " << hits << " from the cache" << std::endl
+              << "             " << dropped << " dropped (" << stale << " too old), "
+              << processed << " processed" << std::endl
+              << "Calls:       " << started << " (" << replies << " replies) in " << seconds << " s" << std::endl
+              << "Throughput:  " << frames / seconds << " frames/s, " << replies / seconds << " replies/s" << std::endl
+              << "End to end:  p50 " << end_to_end.percentile(0.5) / 1000.0
+              << " ms, p99 " << end_to_end.percentile(0.99) / 1000.0
+              << " ms, p99.9 " << end_to_end.percentile(0.999) / 1000.0 << " ms" << std::endl
+              << "Age at call: p50 " << at_call.percentile(0.5) / 1000.0
+              << " ms, p99 " << at_call.percentile(0.99) / 1000.0 << " ms" << std::endl
+              << "Uploaded:    " << platform.bytes() / 1024.0 << " KB, "
+              << (calls > 0 ? platform.bytes() / calls / 1024.0 : 0) << " KB per call" << std::endl
+              << "CPU:         " << cpu_ms / frames << " ms per frame, "
+              << 100 * cpu_ms / 1000.0 / seconds << " % of a core" << std::endl
+              << "Memory:      " << steady_allocations << " allocations on the frame path and "
+              << steady_misses << " frames outside the pool after the first " << warm_up << " frames"
+              << (measured ? "" : " (the replay was too short to tell)") << ", "
+              << opencv_per_frame << " allocations per frame in OpenCV and "
+              << codec_per_frame << " in the codec; "
+              << leases << " frames from the pool, " << misses << " allocated outside it" << std::endl;
+    pipeline::latency().print_text(std::cout);
+    std::cout << stages_print.str();
+    if (status != 0) {
+        std::cerr << "The frame path allocated after the warm-up" << std::endl;
+    }
+    return status;
+}
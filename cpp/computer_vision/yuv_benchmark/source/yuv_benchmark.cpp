@@ -0,0 +1,183 @@
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <opencv2/opencv.hpp>
+
+#include <pipeline/clock.hpp>
+#include <pipeline/recording.hpp>
+#include <pipeline/yuv422.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/// \brief the YUYV frames of a raw recording of the camera of NAO, one buffer of getImageRemote after the other
+static std::vector<cv::Mat> load_raw(const std::string & path, int width, int height)
+{
+    std::vector<cv::Mat> frames;
+    std::ifstream file(path.c_str(), std::ios::binary);
+    for (;;) {
+        cv::Mat yuyv(height, width, CV_8UC2);
+        if (!file.read(reinterpret_cast<char*>(yuyv.data), yuyv.total() * yuyv.elemSize())) {
+            break;
+        }
+        frames.push_back(yuyv);
+    }
+    return frames;
+}
+
+/// \brief \a bgr packed as the camera of NAO gives it: Y0 U Y1 V, the chroma of two pixels averaged
+static cv::Mat pack_yuyv(const cv::Mat & bgr)
+{
+    cv::Mat yuv;
+    cv::cvtColor(bgr, yuv, CV_BGR2YUV);
+    const int width = yuv.cols & ~1;
+    cv::Mat yuyv(yuv.rows, width, CV_8UC2);
+    for (int y = 0; y < yuv.rows; ++y) {
+        const uchar * src = yuv.ptr<uchar>(y);
+        uchar * dst = yuyv.ptr<uchar>(y);
+        for (int x = 0; x < width; x += 2) {
+            dst[2 * x] = src[3 * x];
+            dst[2 * x + 1] = static_cast<uchar>((src[3 * x + 1] + src[3 * x + 4] + 1) / 2);
+            dst[2 * x + 2] = src[3 * x + 3];
+            dst[2 * x + 3] = static_cast<uchar>((src[3 * x + 2] + src[3 * x + 5] + 1) / 2);
+        }
+    }
+    return yuyv;
+}
+
+/*
+ * \brief Measures the conversion of the YUV422 frames of NAO: the BGR
+ *  of NAOqi (and the grayscale the codec makes from it) against the
+ *  kernels of pipeline::yuv422, on a recorded buffer.
+ */
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        std::cerr << "Usage 'yuv_benchmark frames.yuv width height [repetitions]'"
+                     " or 'yuv_benchmark frames_folder_or_video [repetitions]'" << std::endl;
+        return 1;
+    }
+    const std::string path = argv[1];
+    const bool raw = path.size() > 4 && path.substr(path.size() - 4) == ".yuv";
+    if (raw && argc < 4) {
+        std::cerr << "A raw recording needs its width and height, e.g. 320 240" << std::endl;
+        return 1;
+    }
+    const int repetitions = std::atoi(argc > (raw ? 4 : 2) ? argv[raw ? 4 : 2] : "20");
+    if (repetitions < 1) {
+        std::cerr << "The repetitions must be a number of at least 1" << std::endl;
+        return 1;
+    }
+
+    /*
+     * A raw recording has the buffers of the camera as they are. Any other
+     * recording is packed in YUYV first, which gives the same work to the
+     * conversions (not the same colours as the camera).
+     */
+    std::vector<cv::Mat> frames;
+    if (raw) {
+        frames = load_raw(path, std::atoi(argv[2]), std::atoi(argv[3]));
+    }
+    else {
+        for (const auto & image : pipeline::load_frames(path, 300)) {
+            frames.push_back(pack_yuyv(image));
+        }
+    }
+    if (frames.empty()) {
+        std::cerr << "No frames found in " << path << std::endl;
+        return 1;
+    }
+    std::cout << "Frames: " << frames.size() << " of "
+              << frames[0].cols << "x" << frames[0].rows << ", kernels: "
+              << pipeline::yuv422::kernels() << std::endl;
+
+    /*
+     * The first path is what the tutorials did: NAOqi converts every frame
+     * to BGR (cv::cvtColor runs the same BT.601 conversion here), and the
+     * codec of the detection services converts it again to grayscale.
+     */
+    cv::Mat bgr, gray;
+    struct path_to_measure
+    {
+        std::string name;
+        std::function<void(const cv::Mat &)> convert;
+    };
+    const std::vector<path_to_measure> paths = {
+        {"naoqi bgr + gray", [&](const cv::Mat & yuyv) {
+            cv::cvtColor(yuyv, bgr, CV_YUV2BGR_YUYV);
+            cv::cvtColor(bgr, gray, CV_BGR2GRAY);
+        }},
+        {"naoqi bgr",   [&](const cv::Mat & yuyv) { cv::cvtColor(yuyv, bgr, CV_YUV2BGR_YUYV); }},
+        {"opencv gray", [&](const cv::Mat & yuyv) { cv::cvtColor(yuyv, gray, CV_YUV2GRAY_YUYV); }},
+        {"gray scalar", [&](const cv::Mat & yuyv) { pipeline::yuv422::to_gray(yuyv, gray, false); }},
+        {"gray simd",   [&](const cv::Mat & yuyv) { pipeline::yuv422::to_gray(yuyv, gray); }},
+        {"bgr scalar",  [&](const cv::Mat & yuyv) { pipeline::yuv422::to_bgr(yuyv, bgr, false); }},
+        {"bgr simd",    [&](const cv::Mat & yuyv) { pipeline::yuv422::to_bgr(yuyv, bgr); }}
+    };
+
+    std::cout << std::left << std::setw(20) << "path"
+              << std::right << std::setw(12) << "ms/frame"
+              << std::setw(10) << "time %" << std::endl;
+    double base_ms = 0;
+    for (const auto & each : paths) {
+        const auto start = pipeline::clock::now();
+        for (int r = 0; r < repetitions; ++r) {
+            for (const auto & yuyv : frames) {
+                each.convert(yuyv);
+            }
+        }
+        const double converted = double(repetitions) * frames.size();
+        const double ms = boost::chrono::duration<double, boost::milli>(pipeline::clock::now() - start).count() / converted;
+        if (base_ms == 0) {
+            base_ms = ms;
+        }
+        std::cout << std::left << std::setw(20) << each.name
+                  << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(12) << ms
+                  << std::setprecision(0)
+                  << std::setw(10) << 100 * ms / base_ms << std::endl;
+    }
+
+    /*
+     * How far the kernels are from OpenCV: the BGR must be within a level
+     * or two; the grayscale is the Y of the camera (studio range), not
+     * the luminance of the BGR, so it differs more but keeps the same edges.
+     */
+    cv::Mat reference, ours, difference;
+    double bgr_max = 0, gray_mean = 0;
+    for (const auto & yuyv : frames) {
+        cv::cvtColor(yuyv, reference, CV_YUV2BGR_YUYV);
+        pipeline::yuv422::to_bgr(yuyv, ours);
+        cv::absdiff(reference, ours, difference);
+        double most = 0;
+        cv::minMaxLoc(difference.reshape(1), nullptr, &most);
+        bgr_max = std::max(bgr_max, most);
+
+        cv::cvtColor(reference, reference, CV_BGR2GRAY);
+        pipeline::yuv422::to_gray(yuyv, ours);
+        cv::absdiff(reference, ours, difference);
+        gray_mean += cv::mean(difference)[0] / frames.size();
+    }
+    std::cout << std::setprecision(2)
+              << "BGR: at most " << bgr_max << " levels from cv::cvtColor" << std::endl
+              << "Gray: " << gray_mean << " levels from the gray of the BGR on average" << std::endl;
+    return 0;
+}
@@ -0,0 +1,30 @@
+# Toolchain to cross-compile for NAO (i686 Atom) from a PC.
+#
+#   cmake -DCMAKE_TOOLCHAIN_FILE=../../cmake/atom-toolchain.cmake ..
+#
+# The compiler is ${ATOM_TOOLCHAIN_PREFIX}gcc and g++ (i686-linux-gnu- by
+# default, e.g. the gcc-multilib cross compilers of Ubuntu). If the environment
+# variable ATOM_SYSROOT points to a copy of the root of the robot (or to the
+# cross toolchain of Aldebaran), the libraries and headers are looked for there
+# first, so the binary links against the same versions the robot has.
+
+set(CMAKE_SYSTEM_NAME Linux)
+set(CMAKE_SYSTEM_PROCESSOR i686)
+
+if(NOT ATOM_TOOLCHAIN_PREFIX)
+    if(DEFINED ENV{ATOM_TOOLCHAIN_PREFIX})
+        set(ATOM_TOOLCHAIN_PREFIX $ENV{ATOM_TOOLCHAIN_PREFIX})
+    else()
+        set(ATOM_TOOLCHAIN_PREFIX "i686-linux-gnu-")
+    endif()
+endif()
+set(CMAKE_C_COMPILER ${ATOM_TOOLCHAIN_PREFIX}gcc)
+set(CMAKE_CXX_COMPILER ${ATOM_TOOLCHAIN_PREFIX}g++)
+
+if(DEFINED ENV{ATOM_SYSROOT})
+    set(CMAKE_SYSROOT $ENV{ATOM_SYSROOT})
+    set(CMAKE_FIND_ROOT_PATH $ENV{ATOM_SYSROOT})
+    set(CMAKE_FIND_ROOT_PATH_MODE_PROGRAM NEVER)
+    set(CMAKE_FIND_ROOT_PATH_MODE_LIBRARY BOTH)
+    set(CMAKE_FIND_ROOT_PATH_MODE_INCLUDE BOTH)
+endif()
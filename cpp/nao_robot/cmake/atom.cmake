@@ -0,0 +1,108 @@
+# Build profile for the Intel Atom Z530 of NAO.
+#
+# Include it at the top of the CMakeLists.txt, after project() and before
+# any find_package, find_library or add_executable, so the static library
+# suffixes and the flags apply to everything which comes after:
+#
+#   include(${CMAKE_CURRENT_SOURCE_DIR}/../cmake/atom.cmake)
+#
+# To cross-compile from a PC, also give the toolchain:
+#
+#   cmake -DCMAKE_TOOLCHAIN_FILE=../../cmake/atom-toolchain.cmake ..
+#
+# Options (cmake -D...):
+#   CMAKE_BUILD_TYPE  Release (default), MinSizeRel, RelWithDebInfo or Debug
+#   ATOM_LTO          link time optimisation (ON by default in Release)
+#   ATOM_PGO          profile guided optimisation: off, generate or use
+#   ATOM_PGO_DIR      folder of the profiles (build/profile by default)
+#   ATOM_STATIC       off, runtime (libstdc++ and libgcc, default) or full
+
+if(NOT CMAKE_BUILD_TYPE)
+    set(CMAKE_BUILD_TYPE Release CACHE STRING
+        "Build type: Release, MinSizeRel, RelWithDebInfo or Debug" FORCE)
+endif()
+message(STATUS "Atom profile: ${CMAKE_BUILD_TYPE}")
+
+# CPU: 32 bits, Atom scheduling and SSE maths (the x87 unit of the Atom is slow).
+# NAOqi needs the GNU dialect: -std=c++1y doesn't work with its headers.
+set(ATOM_CPU_FLAGS "-m32 -march=atom -mtune=atom -mfpmath=sse")
+set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} ${ATOM_CPU_FLAGS}")
+set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} ${ATOM_CPU_FLAGS} -std=gnu++1y -Wall")
+set(CMAKE_EXE_LINKER_FLAGS "${CMAKE_EXE_LINKER_FLAGS} -m32")
+
+# One optimisation level per build type, never two of them in the same line.
+set(CMAKE_C_FLAGS_RELEASE "-O2 -DNDEBUG")
+set(CMAKE_CXX_FLAGS_RELEASE "-O2 -DNDEBUG")
+set(CMAKE_C_FLAGS_MINSIZEREL "-Os -DNDEBUG")
+set(CMAKE_CXX_FLAGS_MINSIZEREL "-Os -DNDEBUG")
+set(CMAKE_EXE_LINKER_FLAGS_RELEASE "-s")
+set(CMAKE_EXE_LINKER_FLAGS_MINSIZEREL "-s")
+
+# Link time optimisation: the pipeline is header only, so LTO lets GCC inline
+# across the stages and librapp. The archives need the GCC wrappers of ar.
+if(CMAKE_BUILD_TYPE STREQUAL "Release" OR CMAKE_BUILD_TYPE STREQUAL "MinSizeRel")
+    set(ATOM_LTO_DEFAULT ON)
+else()
+    set(ATOM_LTO_DEFAULT OFF)
+endif()
+option(ATOM_LTO "Link time optimisation" ${ATOM_LTO_DEFAULT})
+if(ATOM_LTO)
+    find_program(ATOM_GCC_AR NAMES ${ATOM_TOOLCHAIN_PREFIX}gcc-ar gcc-ar)
+    find_program(ATOM_GCC_RANLIB NAMES ${ATOM_TOOLCHAIN_PREFIX}gcc-ranlib gcc-ranlib)
+    if(ATOM_GCC_AR AND ATOM_GCC_RANLIB)
+        set(CMAKE_AR ${ATOM_GCC_AR})
+        set(CMAKE_RANLIB ${ATOM_GCC_RANLIB})
+    endif()
+    set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} -flto")
+    set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -flto")
+    set(CMAKE_EXE_LINKER_FLAGS "${CMAKE_EXE_LINKER_FLAGS} -flto -fuse-linker-plugin")
+    message(STATUS "Atom profile: link time optimisation")
+endif()
+
+# Profile guided optimisation, in two builds:
+#   1. cmake -DATOM_PGO=generate .. && make, and run the program on a
+#      replay (e.g. face_detection --replay frames --stand-in) until Ctrl+C:
+#      the profiles are written in ATOM_PGO_DIR when it exits.
+#   2. cmake -DATOM_PGO=use .. && make, with the same ATOM_PGO_DIR.
+# The calls run in several threads, so the counters are not exact:
+# -fprofile-correction accepts it.
+set(ATOM_PGO "off" CACHE STRING "Profile guided optimisation: off, generate or use")
+set_property(CACHE ATOM_PGO PROPERTY STRINGS off generate use)
+set(ATOM_PGO_DIR "${CMAKE_BINARY_DIR}/profile" CACHE PATH "Folder of the profiles")
+if(ATOM_PGO STREQUAL "generate")
+    file(MAKE_DIRECTORY ${ATOM_PGO_DIR})
+    set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} -fprofile-generate=${ATOM_PGO_DIR}")
+    set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -fprofile-generate=${ATOM_PGO_DIR}")
+    set(CMAKE_EXE_LINKER_FLAGS "${CMAKE_EXE_LINKER_FLAGS} -fprofile-generate=${ATOM_PGO_DIR}")
+    # the profiles are written at exit, so the binary must keep its symbols
+    set(CMAKE_EXE_LINKER_FLAGS_RELEASE "")
+    set(CMAKE_EXE_LINKER_FLAGS_MINSIZEREL "")
+    message(STATUS "Atom profile: writing profiles in ${ATOM_PGO_DIR}")
+elseif(ATOM_PGO STREQUAL "use")
+    set(ATOM_PGO_FLAGS "-fprofile-use=${ATOM_PGO_DIR} -fprofile-correction -Wno-coverage-mismatch")
+    set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} ${ATOM_PGO_FLAGS}")
+    set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} ${ATOM_PGO_FLAGS}")
+    set(CMAKE_EXE_LINKER_FLAGS "${CMAKE_EXE_LINKER_FLAGS} -fprofile-use=${ATOM_PGO_DIR}")
+    message(STATUS "Atom profile: using the profiles of ${ATOM_PGO_DIR}")
+elseif(NOT ATOM_PGO STREQUAL "off")
+    message(FATAL_ERROR "ATOM_PGO must be off, generate or use")
+endif()
+
+# Static linking. NAO has an old libstdc++ (GLIBCXX_3.4.14), so the runtime
+# of our compiler always goes in the binary. With `full` everything is
+# static: the libraries found after this point are the .a ones.
+set(ATOM_STATIC "runtime" CACHE STRING "Static linking: off, runtime or full")
+set_property(CACHE ATOM_STATIC PROPERTY STRINGS off runtime full)
+if(ATOM_STATIC STREQUAL "runtime" OR ATOM_STATIC STREQUAL "full")
+    set(CMAKE_EXE_LINKER_FLAGS "${CMAKE_EXE_LINKER_FLAGS} -static-libstdc++ -static-libgcc")
+endif()
+if(ATOM_STATIC STREQUAL "full")
+    set(CMAKE_FIND_LIBRARY_SUFFIXES ".a")
+    set(Boost_USE_STATIC_LIBS ON)
+    set(OPENSSL_USE_STATIC_LIBS ON)
+    set(BUILD_SHARED_LIBS OFF)
+    set(CMAKE_EXE_LINKER_FLAGS "${CMAKE_EXE_LINKER_FLAGS} -static")
+    message(STATUS "Atom profile: static executable")
+elseif(NOT ATOM_STATIC STREQUAL "off" AND NOT ATOM_STATIC STREQUAL "runtime")
+    message(FATAL_ERROR "ATOM_STATIC must be off, runtime or full")
+endif()
@@ -7,140 +7,190 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 // RAPP API includes
 #include <rapp/cloud/service_controller.hpp>
 #include <rapp/cloud/vision_detection.hpp>
 #include <rapp/objects/picture.hpp>
 //Boost
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp> 
 #include <boost/chrono.hpp>
+// Pipeline includes
+#include <pipeline/codec.hpp>
+#include <pipeline/fleet_dispatcher.hpp>
+#include <pipeline/latency.hpp>
+#include <pipeline/nao_camera.hpp>
+#include <pipeline/replay_camera.hpp>
+#include <pipeline/stand_in_platform.hpp>
+#include <pipeline/stop_signal.hpp>
 
 
-/**
-* \brief Shows images retrieved from the robot.
-*
-* \param robotIp the IP adress of the robot
-*/
-void showImages(const std::string& robotIp, cv::Mat& rapp_image)
-{
-    /** Create a proxy to ALVideoDevice on the robot.*/
-    AL::ALVideoDeviceProxy camProxy(robotIp, 9559);
-
-    /** Subscribe a client image requiring 320*240 and BGR colorspace.*/
-    const std::string clientName = camProxy.subscribe("test", AL::kQVGA, AL::kBGRColorSpace, 30);
-
-    /** Create an cv::Mat header to wrap into an opencv image.*/
-    cv::Mat imgHeader = cv::Mat(cv::Size(320, 240), CV_8UC3);
-
-    /** Retrieve an image from the camera.
-    * The image is returned in the form of a container object, with the
-    * following fields:
-    * 0 = width
-    * 1 = height
-    * 2 = number of layers
-    * 3 = colors space index (see alvisiondefinitions.h)
-    * 4 = time stamp (seconds)
-    * 5 = time stamp (micro seconds)
-    * 6 = image buffer (size of width * height * number of layers)
-    */
-    AL::ALValue img = camProxy.getImageRemote(clientName);
-
-    /** Access the image buffer (6th field) and assign it to the opencv image
-    * container. */
-    imgHeader.data = (uchar*) img[6].GetBinary();
-    imgHeader.copyTo(rapp_image);
-
-    /** Tells to ALVideoDevice that it can give back the image buffer to the
-    * driver. Optional after a getImageRemote but MANDATORY after a getImageLocal.*/
-    camProxy.releaseImage(clientName);
-
-    /** Cleanup.*/
-    camProxy.unsubscribe(clientName);
-}
-
 /*
- * \brief Example of detecting faces with NAO camera
+ * \brief Example of detecting faces with the cameras of one or more NAO robots
  */
 int main(int argc, char* argv[])
 {
     if (argc < 2)
     {
-        std::cerr << "Usage 'getimages robotIp'" << std::endl;
+        std::cerr << "Usage 'face_detection [--local] [--stand-in] robotIp [robotIp ...] [--replay frames_folder ...]'" << std::endl;
         return 1;
     }
 
-    const std::string robotIp(argv[1]);
-    cv::Mat frame;
+    /*
+     * One process serves the whole fleet: every robot IP is a camera,
+     * and `--replay folder` adds recorded frames, so we can run
+     * and measure this program without the robots.
+     * The camera of NAO is subscribed only once, in its native YUV422,
+     * and keeps streaming while we make the calls: we keep only the
+     * luminance of the frames, which is all face detection needs, so
+     * NAOqi doesn't convert them to BGR on the robot.
+     * With `--local`, when the program runs inside NAOqi on the robot,
+     * the camera lends us the buffer of the driver (getImageLocal)
+     * instead of sending every image through an AL::ALValue.
+     * With `--stand-in` the calls go to a local stand-in of the platform,
+     * so a replay runs without network: that is how we train the
+     * profile guided build (ATOM_PGO=generate) on a known workload.
+     */
+    bool local = false;
+    bool stand_in = false;
+    std::vector<std::string> robots, recordings;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--local") {
+            local = true;
+        }
+        else if (arg == "--stand-in") {
+            stand_in = true;
+        }
+        else if (arg == "--replay" && i + 1 < argc) {
+            recordings.push_back(argv[++i]);
+        }
+        else {
+            robots.push_back(arg);
+        }
+    }
+
+    std::vector<std::unique_ptr<pipeline::frame_source>> cameras;
+    try
+    {
+        for (const auto & ip : robots) {
+            cameras.emplace_back(new pipeline::nao_camera(ip, AL::kQVGA, AL::kYUV422ColorSpace, 30,
+                                                          local ? pipeline::nao_camera::local
+                                                                : pipeline::nao_camera::remote));
+        }
+    }
+    catch (const AL::ALError& e)
+    {
+        std::cerr << "Caught exception " << e.what() << std::endl;
+        return 1;
+    }
+    for (const auto & folder : recordings) {
+        cameras.emplace_back(new pipeline::replay_camera(folder));
+    }
+    std::vector<pipeline::frame_source*> fleet;
+    for (const auto & each : cameras) {
+        fleet.push_back(each.get());
+    }
 
     /*
-     * Construct the platform info setting the hostname/IP, port and authentication token
-     * Then proceed to create a cloud controller.
-     * We'll use this object to create cloud calls to the platform.
+     * Construct the platform info setting the hostname/IP, port and authentication token.
+     * The dispatcher creates the cloud controllers from it.
      */
     rapp::cloud::platform info = {"155.207.19.229", "9001", "rapp_token"}; 
-    rapp::cloud::service_controller ctrl(info);
+    std::unique_ptr<pipeline::stand_in_platform> platform;
+    if (stand_in) {
+        platform.reset(new pipeline::stand_in_platform());
+        info = platform->info();
+    }
 
     /*
-     * Construct a lambda, std::function or bind your own functor.
-     * In this example we'll pass an inline lambda as the callback.
-     * All it does is to show how many faces have been found and 
-     * show a rectangle in the picture where is that face.
+     * Ctrl+C or a SIGTERM stop the program, and the stages stop in order.
+     * A clean exit also matters for the profile guided build: the profiles
+     * are only written when the program returns from main.
      */
-    auto callback = [&](std::vector<rapp::object::face> faces) { 
-        std::cout << "Found: " << faces.size() << " faces" << std::endl; 
-        for(auto each_face : faces) {
-            cv::rectangle(frame,
-            cv::Point(each_face.get_left_x(), each_face.get_left_y()),
-            cv::Point(each_face.get_right_x(), each_face.get_right_x()),
-            cv::Scalar(255,0,0),
-            1, 8, 0);
-            cv::imwrite("Face.png",frame);
-        }
-    };
+    pipeline::stop_signal stop;
 
     /*
-     * We create a variable chrono to count the time.
-     * It's going to be used for making the call every
-     * 500 ms. If we don't do it, we could block the platform.
-     * Other way, if you don't use the windows interface, it's to 
-     * make the call like the `loop.cpp` example.
+     * The calls run in the workers of the dispatcher, maybe several at the
+     * same time, so they share the console and the images under this mutex.
      */
-	auto before = boost::chrono::system_clock::now();
+    boost::mutex output;
 
     /*
-     * Infinite loop 
-     * All it does is every 500 ms is going to read the picture
-     * from the camera of NAO and create a picture object with this 
-     * image. After that we make the call to do the face detection
+     * Construct a lambda, std::function or bind your own functor.
+     * The dispatcher gives us the controller, the picture, the number of
+     * the camera and a copy of the frame which was uploaded.
+     * The callback shows how many faces have been found, draws a rectangle
+     * around every face and saves the image in `Face.png` (`Face_N.png`
+     * with more than one camera).
+     * We pass the picture with std::cref, otherwise make_call would copy it.
      */
-    for (;;) {
-		auto now = boost::chrono::system_clock::now();
-        auto elapsed = boost::chrono::duration_cast<boost::chrono::milliseconds>(now - before).count(); 
-
-		if (elapsed > 500) {
-            try
-            {
-               showImages(robotIp, frame);
+    auto call = [&](rapp::cloud::service_controller & cloud,
+                    const rapp::object::picture & pic,
+                    std::size_t source,
+                    const pipeline::frame & shot) {
+        bool replied = false;
+        cv::Mat image = shot.image;
+        auto callback = [&](std::vector<rapp::object::face> faces) { 
+            replied = true;
+            boost::unique_lock<boost::mutex> lock(output);
+            std::cout << "Camera " << source << ": found " << faces.size() << " faces" << std::endl; 
+            for(auto each_face : faces) {
+                cv::rectangle(image,
+                cv::Point(each_face.get_left_x(), each_face.get_left_y()),
+                cv::Point(each_face.get_right_x(), each_face.get_right_y()),
+                cv::Scalar(255,0,0),
+                1, 8, 0);
             }
-            catch (const AL::ALError& e)
-            {
-                std::cerr << "Caught exception " << e.what() << std::endl;
+            if (!faces.empty()) {
+                cv::imwrite(cameras.size() == 1 ? std::string("Face.png")
+                                                : "Face_" + std::to_string(source) + ".png", image);
             }
-            
-            if(!frame.empty()) {
-                std::vector<int> param = {{ CV_IMWRITE_PNG_COMPRESSION, 3 }};
-                cv::vector<uchar> buf;
-                cv::imencode(".png", frame, buf, param);
-                std::vector<rapp::types::byte> bytes(buf.begin(), buf.end());
-                rapp::object::picture pic(bytes);
+        };
+        cloud.make_call<rapp::cloud::face_detection>(std::cref(pic), true, callback);
+        return replied;
+    };
 
-                before = now;
-                ctrl.make_call<rapp::cloud::face_detection>(pic, true, callback);
-            }
-	    }
+    /*
+     * The fleet dispatcher has a worker per core, which look for the
+     * cameras whose next call is due, take their newest picture, encode it
+     * in place and make the call. Every camera has:
+     * - its own rate controller, which starts with a call every 500 ms and
+     *   then follows the latency and the errors of the replies, so we don't
+     *   block the platform. It uses a steady clock, because the clock of the
+     *   robot can jump when it's synchronised.
+     * - its own change detector: most of the day a robot sees a static scene,
+     *   so if nothing has moved we don't make the call and the last result
+     *   (and `Face.png`) is still valid.
+     * - never more than one call in flight, so a slow robot doesn't take
+     *   the workers of the others.
+     *
+     * Face detection doesn't need the colour nor a lossless image, so the
+     * default codec of the service is a grayscale JPEG: it is much faster
+     * to encode than a PNG on the Atom of NAO, and much smaller.
+     */
+    pipeline::fleet_settings settings;
+    settings.keep_frames = true;
+    pipeline::fleet_dispatcher dispatcher(info, fleet,
+                                          pipeline::default_codec<rapp::cloud::face_detection>::get(),
+                                          call, settings);
+
+    /*
+     * The dispatcher does all the work; every 10 seconds, until we are
+     * stopped, we show how many calls every camera has made and how long
+     * every stage takes (count, mean, p50, p99, p99.9 and max in ms).
+     */
+    while (!stop.wait_for(boost::chrono::seconds(10))) {
+        boost::unique_lock<boost::mutex> lock(output);
+        dispatcher.print(std::cout);
+        pipeline::latency().print_text(std::cout);
     }
 
     return 0;
@@ -1,6 +1,4 @@
 // Aldebaran includes.
-#include <alproxies/alvideodeviceproxy.h>
-#include <alvision/alimage.h>
 #include <alvision/alvisiondefinitions.h>
 #include <alerror/alerror.h>
 
@@ -8,117 +6,112 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
+#include <functional>
+#include <memory>
 #include <iostream>
 #include <string>
+#include <vector>
 // RAPP API includes
 #include <rapp/cloud/service_controller.hpp>
 #include <rapp/cloud/vision_detection.hpp>
 #include <rapp/objects/picture.hpp>
 
-#include <boost/date_time/posix_time/posix_time.hpp>
-#include <boost/thread/thread.hpp> 
-
-/**
-* \brief Shows images retrieved from the robot.
-*
-* \param robotIp the IP adress of the robot
-*/
-void showImages(const std::string& robotIp, cv::Mat& rapp_image)
-{
-    /** Create a proxy to ALVideoDevice on the robot.*/
-    AL::ALVideoDeviceProxy camProxy(robotIp, 9559);
-
-    /** Subscribe a client image requiring 320*240 and BGR colorspace.*/
-    const std::string clientName = camProxy.subscribe("test", AL::kQVGA, AL::kBGRColorSpace, 30);
-
-    /** Create an cv::Mat header to wrap into an opencv image.*/
-    cv::Mat imgHeader = cv::Mat(cv::Size(320, 240), CV_8UC3);
-
-    /** Retrieve an image from the camera.
-    * The image is returned in the form of a container object, with the
-    * following fields:
-    * 0 = width
-    * 1 = height
-    * 2 = number of layers
-    * 3 = colors space index (see alvisiondefinitions.h)
-    * 4 = time stamp (seconds)
-    * 5 = time stamp (micro seconds)
-    * 6 = image buffer (size of width * height * number of layers)
-    */
-    AL::ALValue img = camProxy.getImageRemote(clientName);
-
-    /** Access the image buffer (6th field) and assign it to the opencv image
-    * container. */
-    imgHeader.data = (uchar*) img[6].GetBinary();
-    imgHeader.copyTo(rapp_image);
-
-    /** Tells to ALVideoDevice that it can give back the image buffer to the
-    * driver. Optional after a getImageRemote but MANDATORY after a getImageLocal.*/
-    camProxy.releaseImage(clientName);
-
-    /** Cleanup.*/
-    camProxy.unsubscribe(clientName);
-}
+#include <boost/chrono.hpp>
+#include <boost/thread/mutex.hpp>
+// Pipeline includes
+#include <pipeline/codec.hpp>
+#include <pipeline/fleet_dispatcher.hpp>
+#include <pipeline/nao_camera.hpp>
+#include <pipeline/stop_signal.hpp>
 
 
 int main(int argc, char* argv[])
 {
     if (argc < 2)
     {
-        std::cerr << "Usage 'getimages robotIp'" << std::endl;
+        std::cerr << "Usage 'face_detection robotIp'" << std::endl;
         return 1;
     }
 
     const std::string robotIp(argv[1]);
-    cv::Mat frame;
 
     /*
-     * Construct the platform info setting the hostname/IP, port and authentication token
-     * Then proceed to create a cloud controller.
-     * We'll use this object to create cloud calls to the platform.
+     * The camera of NAO is subscribed once, at 320x240 in its native
+     * YUV422, and keeps streaming while we make the calls. The frames are
+     * converted to grayscale on our side (face detection needs no colour),
+     * so NAOqi doesn't convert them to BGR first.
      */
-    rapp::cloud::platform info = {"155.207.19.229", "9001", "rapp_token"}; 
-    rapp::cloud::service_controller ctrl(info);
+    std::unique_ptr<pipeline::nao_camera> camera;
+    try
+    {
+        camera.reset(new pipeline::nao_camera(robotIp, AL::kQVGA, AL::kYUV422ColorSpace, 30));
+    }
+    catch (const AL::ALError& e)
+    {
+        std::cerr << "Caught exception " << e.what() << std::endl;
+        return 1;
+    }
+    std::vector<pipeline::frame_source*> cameras = {camera.get()};
+
+    /*
+     * Construct the platform info setting the hostname/IP, port and authentication token.
+     * The dispatcher creates the cloud controllers from it.
+     */
+    rapp::cloud::platform info = {"155.207.19.229", "9001", "rapp_token"};
 
     /*
      * Construct a lambda, std::function or bind your own functor.
-     * In this example we'll pass an inline lambda as the callback.
-     * All it does is to show how many faces have been found and 
-     * show a rectangle in the picture where is that face.
+     * The dispatcher gives us the controller, the picture, the number of
+     * the camera and a copy of the frame which was uploaded.
+     * All it does is to show how many faces have been found, draw a
+     * rectangle around every face and save the image in `face.png`.
+     * We pass the picture with std::cref, otherwise make_call would copy it.
      */
-    auto callback = [&](std::vector<rapp::object::face> faces) { 
-        std::cout << "Found: " << faces.size() << " faces" << std::endl; 
-        for(auto each_face : faces) {
-            cv::rectangle(frame,
-            cv::Point(each_face.get_left_x(), each_face.get_left_y()),
-            cv::Point(each_face.get_right_x(), each_face.get_right_x()),
-            cv::Scalar(255,0,0),
-            1, 8, 0);
-        }
+    boost::mutex output;
+    auto call = [&](rapp::cloud::service_controller & ctrl,
+                    const rapp::object::picture & pic,
+                    std::size_t,
+                    const pipeline::frame & shot) {
+        bool replied = false;
+        cv::Mat image = shot.image;
+        auto callback = [&](std::vector<rapp::object::face> faces) {
+            replied = true;
+            boost::unique_lock<boost::mutex> lock(output);
+            std::cout << "Found: " << faces.size() << " faces" << std::endl;
+            for(auto each_face : faces) {
+                cv::rectangle(image,
+                cv::Point(each_face.get_left_x(), each_face.get_left_y()),
+                cv::Point(each_face.get_right_x(), each_face.get_right_y()),
+                cv::Scalar(255,0,0),
+                1, 8, 0);
+            }
+            if (!faces.empty()) {
+                cv::imwrite("face.png", image);
+            }
+        };
+        ctrl.make_call<rapp::cloud::face_detection>(std::cref(pic), true, callback);
+        return replied;
     };
 
     /*
-     * Call the function to take the image from NAO. It reads
-     * from the camera of NAO and create a picture object with this 
-     * image. After that we make the call to do the face detection
+     * The dispatcher of the library takes the newest image of the camera,
+     * encodes it with the default codec of face detection (a grayscale
+     * JPEG) and makes the call, as often as its rate controller allows
+     * and only when the scene has changed, so we don't block the platform.
      */
-    try
-    {
-       showImages(robotIp, frame);
-    }
-    catch (const AL::ALError& e)
-    {
-        std::cerr << "Caught exception " << e.what() << std::endl;
-    }
-    
-    if(!frame.empty()) {
-        std::vector<int> param = {{ CV_IMWRITE_PNG_COMPRESSION, 3 }};
-        cv::vector<uchar> buf;
-        cv::imencode(".png", frame, buf, param);
-        std::vector<rapp::types::byte> bytes(buf.begin(), buf.end());
-        rapp::object::picture pic(bytes);
+    pipeline::fleet_settings settings;
+    settings.keep_frames = true;
+    pipeline::fleet_dispatcher dispatcher(info, cameras,
+                                          pipeline::default_codec<rapp::cloud::face_detection>::get(),
+                                          call, settings);
 
-        ctrl.make_call<rapp::cloud::face_detection>(pic, true, callback);
+    /*
+     * Until Ctrl+C, every 10 seconds we show how many calls have been made.
+     */
+    pipeline::stop_signal stop;
+    while (!stop.wait_for(boost::chrono::seconds(10))) {
+        boost::unique_lock<boost::mutex> lock(output);
+        dispatcher.print(std::cout);
     }
 
     return 0;
@@ -0,0 +1,72 @@
+#ifndef PIPELINE_ALLOCATION_SITE_HPP
+#define PIPELINE_ALLOCATION_SITE_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+namespace pipeline {
+
+/**
+ * \brief What the current thread is doing, for a program which counts its allocations.
+ *
+ * The threads which carry the frames from the camera to the encoders
+ * (capture, cache, roi, batch, scale, encode) are on the \a frame_path:
+ * their own work (queues, pools, maps, frames) must not allocate once the
+ * pools are warm. They leave it while OpenCV works on the pixels, whose
+ * functions (resize, color conversion, the local detector, a camera
+ * decoding its frame) allocate scratch buffers inside, and while the
+ * codec runs: OpenCV's encoder and the bytes the picture keeps are
+ * allocated for every frame. Both are counted apart. The results handed
+ * to the program, and every other thread (the dispatcher, the cloud
+ * calls, the window), are \a elsewhere.
+ * A program which counts its allocations, like pipeline_benchmark, reads
+ * current_allocation_site(); otherwise it costs one thread_local write
+ * per scope.
+ */
+enum class allocation_site { elsewhere, frame_path, opencv, codec };
+
+/// \brief the site of the current thread
+inline allocation_site & current_allocation_site()
+{
+    thread_local allocation_site site = allocation_site::elsewhere;
+    return site;
+}
+
+/**
+ * \brief Puts the current thread on \a site until it goes out of scope.
+ * \class allocation_scope
+ */
+class allocation_scope
+{
+public:
+    explicit allocation_scope(allocation_site site)
+    : previous_(current_allocation_site())
+    {
+        current_allocation_site() = site;
+    }
+
+    allocation_scope(const allocation_scope &) = delete;
+    allocation_scope & operator=(const allocation_scope &) = delete;
+
+    ~allocation_scope()
+    {
+        current_allocation_site() = previous_;
+    }
+
+private:
+    const allocation_site previous_;
+};
+
+}
+#endif
@@ -0,0 +1,220 @@
+#ifndef PIPELINE_ASYNC_CONTROLLER_HPP
+#define PIPELINE_ASYNC_CONTROLLER_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/bounded_queue.hpp>
+#include <pipeline/controller_pool.hpp>
+
+#include <rapp/cloud/service_controller.hpp>
+#include <rapp/objects/picture.hpp>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <exception>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+namespace pipeline {
+
+/**
+ * \brief Non-blocking cloud calls with a window of calls in flight.
+ * \class async_controller
+ *
+ * rapp::cloud::service_controller::make_call blocks until the reply
+ * arrives, so a single controller never has more than one call on the
+ * wire and the round trip to the platform is paid once per call.
+ * This class keeps \a window workers, which take a controller from a
+ * controller_pool for every call, and lets the caller submit calls and go on: up to \a window calls
+ * overlap, which hides the latency of the network behind each other.
+ *
+ * \a submit waits only when the window is full, \a try_submit never waits.
+ * Completion is reported with a std::future, and the callbacks of the
+ * services run on the worker threads. A call which throws, whatever it
+ * throws, frees its place in the window and its future holds the exception.
+ */
+class async_controller
+{
+public:
+    /// \brief makes the call with the controller of a worker, true if the platform replied
+    typedef std::function<bool(rapp::cloud::service_controller &)> call_function;
+
+    async_controller(const rapp::cloud::platform & info, unsigned int window)
+    : window_(window), tasks_(window), controllers_(info, window)
+    {
+        for (unsigned int i = 0; i < window; ++i) {
+            threads_.create_thread([this]{ run(); });
+        }
+    }
+
+    /// \brief wait for the calls in flight and join the workers
+    ~async_controller()
+    {
+        tasks_.close();
+        threads_.join_all();
+    }
+
+    async_controller(const async_controller &) = delete;
+    async_controller & operator=(const async_controller &) = delete;
+
+    /// \brief submit \a call, waiting while the window is full
+    std::future<bool> submit(call_function call)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            while (in_flight_ >= window_) {
+                slot_free_.wait(lock);
+            }
+            ++in_flight_;
+        }
+        return enqueue(std::move(call));
+    }
+
+    /// \brief submit \a call only if the window has room, false otherwise
+    bool try_submit(call_function call, std::future<bool> * done = nullptr)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            if (in_flight_ >= window_) {
+                return false;
+            }
+            ++in_flight_;
+        }
+        auto result = enqueue(std::move(call));
+        if (done) {
+            *done = std::move(result);
+        }
+        return true;
+    }
+
+    /**
+     * \brief make a call of \a Service on \a pic and get its reply as a future.
+     * \a args are the arguments of the service between the picture and
+     * the callback (e.g. `true` for the fast mode of face_detection).
+     * If the platform doesn't reply, the future holds an exception, and if
+     * the call throws, the future holds what it threw.
+     *
+     * \code
+     * auto faces = ctrl.request<rapp::cloud::face_detection,
+     *                           std::vector<rapp::object::face>>(std::move(pic), true);
+     * \endcode
+     */
+    template <class Service, class Reply, typename... Args>
+    std::future<Reply> request(rapp::object::picture pic, Args... args)
+    {
+        auto image = std::make_shared<rapp::object::picture>(std::move(pic));
+        auto reply = std::make_shared<std::promise<Reply>>();
+        auto result = reply->get_future();
+        submit([=](rapp::cloud::service_controller & ctrl) {
+            bool replied = false;
+            std::function<void(Reply)> callback = [&](Reply value) {
+                replied = true;
+                reply->set_value(std::move(value));
+            };
+            try {
+                ctrl.make_call<Service>(std::cref(*image), args..., callback);
+            }
+            catch (...) {
+                if (!replied) {
+                    reply->set_exception(std::current_exception());
+                }
+                throw;
+            }
+            if (!replied) {
+                reply->set_exception(std::make_exception_ptr(
+                                std::runtime_error("no reply from the platform")));
+            }
+            return replied;
+        });
+        return result;
+    }
+
+    /// \brief the controllers used by the workers, with their counters
+    const controller_pool & controllers() const
+    {
+        return controllers_;
+    }
+
+    /// \brief number of calls submitted and not finished yet
+    unsigned int in_flight() const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        return in_flight_;
+    }
+
+private:
+    struct task
+    {
+        call_function call;
+        std::shared_ptr<std::promise<bool>> done;
+    };
+
+    std::future<bool> enqueue(call_function call)
+    {
+        task next = {std::move(call), std::make_shared<std::promise<bool>>()};
+        auto result = next.done->get_future();
+        auto done = next.done;
+        if (!tasks_.push(std::move(next))) {
+            done->set_value(false);
+            release();
+        }
+        return result;
+    }
+
+    void release()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        --in_flight_;
+        slot_free_.notify_one();
+    }
+
+    void run()
+    {
+        task current;
+        while (tasks_.pop(current)) {
+            try {
+                auto ctrl = controllers_.acquire();
+                current.done->set_value(current.call(*ctrl));
+            }
+            catch (const std::exception & e) {
+                std::cerr << "cloud call failed: " << e.what() << std::endl;
+                current.done->set_exception(std::current_exception());
+            }
+            catch (...) {
+                std::cerr << "cloud call failed" << std::endl;
+                current.done->set_exception(std::current_exception());
+            }
+            current = task();
+            release();
+        }
+    }
+
+    const unsigned int window_;
+    bounded_queue<task> tasks_;
+    controller_pool controllers_;
+    mutable boost::mutex mutex_;
+    boost::condition_variable slot_free_;
+    unsigned int in_flight_ = 0;
+    boost::thread_group threads_;
+};
+
+}
+#endif
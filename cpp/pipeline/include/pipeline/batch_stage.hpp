@@ -0,0 +1,250 @@
+#ifndef PIPELINE_BATCH_STAGE_HPP
+#define PIPELINE_BATCH_STAGE_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/allocation_site.hpp>
+#include <pipeline/bounded_queue.hpp>
+#include <pipeline/clock.hpp>
+#include <pipeline/frame.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace pipeline {
+
+/// \brief how many frames go in one call and how long a batch waits for them
+struct batch_settings
+{
+    /// frames in one call, 1 disables batching
+    std::size_t size = 1;
+    /// a batch is sent when it's full or when its first frame is this old
+    clock::duration max_wait = boost::chrono::milliseconds(200);
+    /// scale of every frame in the mosaic, smaller tiles keep the upload small
+    double scale = 1.0;
+};
+
+/// \brief the detections of one frame of a batch
+typedef std::pair<std::uint64_t, std::vector<detection>> frame_result;
+
+/**
+ * \brief Puts several frames in one cloud call.
+ * \class batch_stage
+ *
+ * Every call pays the HTTP request, the token and the start of the service
+ * on the platform, whatever the size of the image. The RAPP services take
+ * one picture per call, so this stage collects up to \a size frames, or as
+ * many as arrive within \a max_wait, and tiles them in a mosaic which is
+ * sent as one picture; \a split maps the boxes found in the mosaic
+ * back to the frames they belong to.
+ * The mosaic has the number of its newest frame. Only services which
+ * return boxes (faces, humans) can be split; a single frame goes through
+ * untouched.
+ *
+ * Bigger batches mean fewer calls per frame, and more latency:
+ * the first frame of a batch waits for the others.
+ * The mosaics are drawn in a frame_pool of \a buffers images, and their
+ * layouts kept in a ring, so the thread, which is on the frame path
+ * (allocation_site), doesn't allocate once it is warm.
+ */
+class batch_stage
+{
+public:
+    batch_stage(bounded_queue<frame> & input,
+                bounded_queue<frame> & output,
+                batch_settings settings = batch_settings(),
+                std::size_t buffers = 4)
+    : input_(input), output_(output), settings_(settings), mosaics_(buffers),
+      thread_([this]{ run(); })
+    {}
+
+    /// \brief close the input queue and join the thread
+    ~batch_stage()
+    {
+        input_.close();
+        thread_.join();
+    }
+
+    /**
+     * \brief the detections of every frame in call \a seq.
+     * Boxes belong to the tile which holds their centre, and are clipped to
+     * it and scaled back to the frame. Every frame of the batch is in the
+     * result, with no detections if none was found in its tile.
+     */
+    std::vector<frame_result> split(std::uint64_t seq, const std::vector<detection> & found) const
+    {
+        std::vector<tile> tiles;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            for (std::size_t i = 0; i < kept_; ++i) {
+                if (layouts_[i].seq == seq) {
+                    tiles = layouts_[i].tiles;
+                    break;
+                }
+            }
+        }
+        if (tiles.empty()) {
+            return {frame_result(seq, found)};
+        }
+
+        std::vector<frame_result> results;
+        for (const auto & each : tiles) {
+            results.push_back(frame_result(each.seq, std::vector<detection>()));
+        }
+        for (const auto & item : found) {
+            const cv::Point centre(item.box.x + item.box.width / 2,
+                                   item.box.y + item.box.height / 2);
+            for (std::size_t i = 0; i < tiles.size(); ++i) {
+                const tile & where = tiles[i];
+                if (!where.area.contains(centre)) {
+                    continue;
+                }
+                const cv::Rect inside = item.box & where.area;
+                const double fx = double(where.original.width) / where.area.width;
+                const double fy = double(where.original.height) / where.area.height;
+                detection mapped;
+                mapped.box = cv::Rect(cvRound((inside.x - where.area.x) * fx),
+                                      cvRound((inside.y - where.area.y) * fy),
+                                      cvRound(inside.width * fx),
+                                      cvRound(inside.height * fy));
+                mapped.label = item.label;
+                results[i].second.push_back(mapped);
+                break;
+            }
+        }
+        return results;
+    }
+
+private:
+    /// \brief where a frame is in a mosaic
+    struct tile
+    {
+        std::uint64_t seq;
+        cv::Rect area;
+        cv::Size original;
+    };
+
+    /// \brief the tiles of a mosaic
+    struct layout
+    {
+        std::uint64_t seq = 0;
+        std::vector<tile> tiles;
+    };
+
+    void run()
+    {
+        allocation_scope site(allocation_site::frame_path);
+        batch_.reserve(settings_.size);
+        tiles_.reserve(settings_.size);
+        frame first;
+        while (input_.pop(first)) {
+            const auto deadline = clock::now() + settings_.max_wait;
+            batch_.push_back(std::move(first));
+
+            frame next;
+            while (batch_.size() < settings_.size && input_.pop_until(next, deadline)) {
+                batch_.push_back(std::move(next));
+            }
+            frame combined = combine(batch_);
+            // the frames of the batch go back to the pool of the camera before we wait for room
+            batch_.clear();
+            if (!output_.push(std::move(combined))) {
+                break;
+            }
+        }
+    }
+
+    /// \brief tile the frames of \a batch in a grid and remember where each one is
+    frame combine(std::vector<frame> & batch)
+    {
+        if (batch.size() == 1 && settings_.scale == 1.0) {
+            return std::move(batch.front());
+        }
+
+        const frame & first = batch.front();
+        const cv::Size size(cvRound(first.image.cols * settings_.scale),
+                            cvRound(first.image.rows * settings_.scale));
+        const int columns = static_cast<int>(std::ceil(std::sqrt(double(batch.size()))));
+        const int rows = static_cast<int>((batch.size() + columns - 1) / columns);
+
+        frame mosaic;
+        mosaic.seq = batch.back().seq;
+        mosaic.captured = first.captured;
+        mosaic.buffer = mosaics_.acquire();
+        if (mosaic.buffer) {
+            mosaic.image = *mosaic.buffer;
+        }
+
+        tiles_.clear();
+        {
+            allocation_scope drawing(allocation_site::opencv);
+            mosaic.image.create(size.height * rows, size.width * columns, first.image.type());
+            mosaic.image.setTo(cv::Scalar::all(0));
+            for (std::size_t i = 0; i < batch.size(); ++i) {
+                const cv::Rect area(size.width * static_cast<int>(i % columns),
+                                    size.height * static_cast<int>(i / columns),
+                                    size.width, size.height);
+                cv::Mat target = mosaic.image(area);
+                if (batch[i].image.size() == size) {
+                    batch[i].image.copyTo(target);
+                }
+                else {
+                    cv::resize(batch[i].image, target, size, 0, 0, cv::INTER_AREA);
+                }
+                tiles_.push_back(tile{batch[i].seq, area, batch[i].image.size()});
+            }
+        }
+        if (mosaic.buffer) {
+            // the first mosaic (or a new size) allocates: keep the pixels for the next lease
+            *mosaic.buffer = mosaic.image;
+        }
+
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        layouts_[next_].seq = mosaic.seq;
+        layouts_[next_].tiles.assign(tiles_.begin(), tiles_.end());
+        next_ = (next_ + 1) % max_layouts;
+        if (kept_ < max_layouts) {
+            ++kept_;
+        }
+        return mosaic;
+    }
+
+    /// calls in flight whose layout is kept
+    static const std::size_t max_layouts = 32;
+
+    bounded_queue<frame> & input_;
+    bounded_queue<frame> & output_;
+    const batch_settings settings_;
+    frame_pool mosaics_;
+    std::vector<frame> batch_;
+    std::vector<tile> tiles_;
+    mutable boost::mutex mutex_;
+    layout layouts_[max_layouts];
+    std::size_t next_ = 0;
+    std::size_t kept_ = 0;
+    boost::thread thread_;
+};
+
+}
+#endif
@@ -0,0 +1,253 @@
+#ifndef PIPELINE_BOUNDED_QUEUE_HPP
+#define PIPELINE_BOUNDED_QUEUE_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <boost/chrono.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace pipeline {
+
+/**
+ * \brief Fixed capacity FIFO used to join two pipeline stages.
+ * \class bounded_queue
+ *
+ * Producers can either wait for room (\a push), give up straight away
+ * (\a try_push) or replace the oldest item (\a push_newest) so that a fast
+ * stage, like the camera, never waits for a slow one. With a capacity of
+ * one, \a push_newest makes the queue a mailbox which always holds the
+ * latest item.
+ * A queue given a \a drop_when predicate drops the items it matches
+ * when they reach the front, e.g. the frames which waited too long:
+ * a stage which falls behind skips them instead of working on the past.
+ * Every item refused or dropped is counted in \a dropped.
+ * Once \a close has been called, producers are refused and consumers
+ * drain the remaining items and then get \a false.
+ * The items live in a ring of \a capacity slots created with the queue,
+ * so pushing and popping never allocate; a slot is reset once its item
+ * has been taken, which gives back what the item held (e.g. a pooled frame).
+ */
+template <typename T>
+class bounded_queue
+{
+public:
+    explicit bounded_queue(std::size_t capacity)
+    : capacity_(capacity), items_(capacity)
+    {}
+
+    bounded_queue(const bounded_queue &) = delete;
+    bounded_queue & operator=(const bounded_queue &) = delete;
+
+    /// \brief wait until there is room and enqueue \a item, false if the queue is closed
+    bool push(T item)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while (!closed_ && count_ >= capacity_) {
+            not_full_.wait(lock);
+        }
+        if (closed_) {
+            return false;
+        }
+        enqueue(std::move(item));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    /// \brief enqueue \a item only if there is room, false if it was dropped
+    bool try_push(T item)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        if (closed_ || count_ >= capacity_) {
+            if (!closed_) {
+                ++dropped_;
+            }
+            return false;
+        }
+        enqueue(std::move(item));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    /// \brief enqueue \a item, dropping the oldest one when the queue is full, false if the queue is closed
+    bool push_newest(T item)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        if (closed_) {
+            return false;
+        }
+        if (count_ >= capacity_) {
+            drop_front();
+            ++dropped_;
+        }
+        enqueue(std::move(item));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    /// \brief wait for an item, false once the queue is closed and empty
+    bool pop(T & item)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        for (;;) {
+            drop_stale();
+            if (closed_ || count_ > 0) {
+                break;
+            }
+            not_empty_.wait(lock);
+        }
+        return take(item);
+    }
+
+    /// \brief wait for an item until \a deadline, false on timeout or once the queue is closed and empty
+    template <class Clock, class Duration>
+    bool pop_until(T & item, const boost::chrono::time_point<Clock, Duration> & deadline)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        for (;;) {
+            drop_stale();
+            if (closed_ || count_ > 0) {
+                break;
+            }
+            if (not_empty_.wait_until(lock, deadline) == boost::cv_status::timeout) {
+                drop_stale();
+                break;
+            }
+        }
+        return take(item);
+    }
+
+    /// \brief dequeue an item if one is ready, without waiting
+    bool try_pop(T & item)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        drop_stale();
+        return take(item);
+    }
+
+    /// \brief dequeue the newest item and drop the older ones, without waiting
+    bool try_pop_newest(T & item)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        drop_stale();
+        if (count_ == 0) {
+            return false;
+        }
+        item = std::move(items_[(head_ + count_ - 1) % capacity_]);
+        dropped_ += count_ - 1;
+        while (count_ > 0) {
+            drop_front();
+        }
+        not_full_.notify_all();
+        return true;
+    }
+
+    /// \brief refuse new items and wake up every waiting thread
+    void close()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+    /// \brief drop the items for which \a stale is true when they reach the front, instead of giving them
+    void drop_when(std::function<bool(const T &)> stale)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        stale_ = std::move(stale);
+    }
+
+    std::size_t size() const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        return count_;
+    }
+
+    /// \brief items refused by \a try_push, replaced by \a push_newest or skipped by \a try_pop_newest, and stale ones
+    std::uint64_t dropped() const
+    {
+        return dropped_;
+    }
+
+    /// \brief items dropped by the \a drop_when predicate
+    std::uint64_t stale() const
+    {
+        return stale_dropped_;
+    }
+
+private:
+    void drop_stale()
+    {
+        if (!stale_) {
+            return;
+        }
+        const std::size_t before = count_;
+        while (count_ > 0 && stale_(items_[head_])) {
+            drop_front();
+            ++dropped_;
+            ++stale_dropped_;
+        }
+        if (count_ < before) {
+            not_full_.notify_all();
+        }
+    }
+
+    bool take(T & item)
+    {
+        if (count_ == 0) {
+            return false;
+        }
+        item = std::move(items_[head_]);
+        drop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    void enqueue(T && item)
+    {
+        items_[(head_ + count_) % capacity_] = std::move(item);
+        ++count_;
+    }
+
+    void drop_front()
+    {
+        items_[head_] = T();
+        head_ = (head_ + 1) % capacity_;
+        --count_;
+    }
+
+    const std::size_t capacity_;
+    mutable boost::mutex mutex_;
+    boost::condition_variable not_empty_;
+    boost::condition_variable not_full_;
+    std::vector<T> items_;
+    std::size_t head_ = 0;
+    std::size_t count_ = 0;
+    bool closed_ = false;
+    std::function<bool(const T &)> stale_;
+    std::atomic<std::uint64_t> dropped_{0};
+    std::atomic<std::uint64_t> stale_dropped_{0};
+};
+
+}
+#endif
@@ -0,0 +1,259 @@
+#ifndef PIPELINE_BOX_TRACKER_HPP
+#define PIPELINE_BOX_TRACKER_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/frame.hpp>
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/video/tracking.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+namespace pipeline {
+
+/// \brief how the box_tracker follows the boxes
+struct tracker_settings
+{
+    /// the tracker runs on the frame scaled by this
+    double scale = 0.5;
+    /// corners followed in every box
+    int points = 20;
+    /// a box is lost when fewer corners than this are still followed
+    std::size_t min_points = 4;
+    /// frames kept to re-anchor a result on the frame it was found in
+    std::size_t history = 32;
+};
+
+/**
+ * \brief Moves the boxes of the cloud on every frame between two replies.
+ * \class box_tracker
+ *
+ * The platform replies a few times per second, so the boxes would jump
+ * and be stale most of the time. The tracker seeds corners inside every
+ * box of a result and follows them with pyramidal Lucas-Kanade optical
+ * flow on every frame: a box moves with the median motion of its corners
+ * and grows or shrinks with their spread.
+ *
+ * A result belongs to a frame which is already some frames old when it
+ * arrives, so \a anchor seeds the corners on that frame, which is kept in
+ * a short history, and follows them up to the newest frame at once.
+ * The history only has the frames given to \a update: when the frame of
+ * the result was skipped (the window shows the newest frame only), the
+ * corners are seeded on the last frame before it, the closest in time.
+ * Not thread-safe: the display thread calls \a update and \a anchor.
+ */
+class box_tracker
+{
+public:
+    explicit box_tracker(tracker_settings settings = tracker_settings())
+    : settings_(settings)
+    {}
+
+    /// \brief follow the boxes on a new frame
+    void update(const frame & latest)
+    {
+        cv::Mat gray = shrink(latest.image);
+        if (!history_.empty()) {
+            step(history_.back().second, gray);
+        }
+        history_.push_back(std::make_pair(latest.seq, gray));
+        while (history_.size() > settings_.history) {
+            history_.pop_front();
+        }
+    }
+
+    /// \brief replace the boxes with the ones found by the platform in frame \a seq
+    void anchor(std::uint64_t seq, const std::vector<detection> & found)
+    {
+        tracked_.clear();
+        fixed_.clear();
+        if (history_.empty()) {
+            return;
+        }
+
+        // the newest frame up to seq, or the oldest one if the result is older than the history
+        std::size_t start = 0;
+        for (std::size_t i = 1; i < history_.size() && history_[i].first <= seq; ++i) {
+            start = i;
+        }
+
+        const cv::Mat & base = history_[start].second;
+        for (const auto & each : found) {
+            if (each.box.area() == 0) {
+                fixed_.push_back(each);
+                continue;
+            }
+            target next;
+            next.item = each;
+            next.box = scaled(each.box, settings_.scale);
+            seed(base, next);
+            if (next.points.size() >= settings_.min_points) {
+                tracked_.push_back(next);
+            }
+        }
+
+        for (std::size_t i = start + 1; i < history_.size(); ++i) {
+            step(history_[i - 1].second, history_[i].second);
+        }
+    }
+
+    /// \brief the boxes on the newest frame
+    std::vector<detection> boxes() const
+    {
+        std::vector<detection> result = fixed_;
+        for (const auto & each : tracked_) {
+            detection item = each.item;
+            item.box = scaled(each.box, 1.0 / settings_.scale);
+            result.push_back(item);
+        }
+        return result;
+    }
+
+private:
+    /// \brief a box and the corners which move it, in the coordinates of the scaled frame
+    struct target
+    {
+        detection item;
+        cv::Rect box;
+        std::vector<cv::Point2f> points;
+    };
+
+    cv::Mat shrink(const cv::Mat & image) const
+    {
+        cv::Mat small, gray;
+        cv::resize(image, small, cv::Size(), settings_.scale, settings_.scale, cv::INTER_AREA);
+        if (small.channels() == 3) {
+            cv::cvtColor(small, gray, CV_BGR2GRAY);
+        }
+        else {
+            gray = small;
+        }
+        return gray;
+    }
+
+    static cv::Rect scaled(const cv::Rect & box, double factor)
+    {
+        return cv::Rect(cvRound(box.x * factor), cvRound(box.y * factor),
+                        cvRound(box.width * factor), cvRound(box.height * factor));
+    }
+
+    void seed(const cv::Mat & gray, target & next) const
+    {
+        const cv::Rect inside = next.box & cv::Rect(0, 0, gray.cols, gray.rows);
+        if (inside.area() == 0) {
+            return;
+        }
+        cv::Mat mask = cv::Mat::zeros(gray.rows, gray.cols, CV_8UC1);
+        mask(inside).setTo(cv::Scalar(255));
+        cv::goodFeaturesToTrack(gray, next.points, settings_.points, 0.01, 3, mask);
+    }
+
+    /// \brief move every box from \a from to \a to
+    void step(const cv::Mat & from, const cv::Mat & to)
+    {
+        for (auto & each : tracked_) {
+            std::vector<cv::Point2f> moved;
+            std::vector<uchar> status;
+            std::vector<float> error;
+            cv::calcOpticalFlowPyrLK(from, to, each.points, moved, status, error);
+
+            std::vector<cv::Point2f> before, after;
+            for (std::size_t i = 0; i < status.size(); ++i) {
+                if (status[i]) {
+                    before.push_back(each.points[i]);
+                    after.push_back(moved[i]);
+                }
+            }
+            each.points = after;
+            if (after.size() < settings_.min_points) {
+                continue;
+            }
+            move(each.box, before, after);
+        }
+        tracked_.erase(std::remove_if(tracked_.begin(), tracked_.end(),
+                                      [this](const target & each) {
+                                          return each.points.size() < settings_.min_points;
+                                      }),
+                       tracked_.end());
+    }
+
+    /// \brief shift \a box by the median motion of the corners and scale it by their spread
+    static void move(cv::Rect & box,
+                     const std::vector<cv::Point2f> & before,
+                     const std::vector<cv::Point2f> & after)
+    {
+        std::vector<float> dx, dy;
+        for (std::size_t i = 0; i < before.size(); ++i) {
+            dx.push_back(after[i].x - before[i].x);
+            dy.push_back(after[i].y - before[i].y);
+        }
+        const cv::Point2f shift(median(dx), median(dy));
+
+        const cv::Point2f centre_before = centre(before);
+        const cv::Point2f centre_after = centre(after);
+        std::vector<float> ratios;
+        for (std::size_t i = 0; i < before.size(); ++i) {
+            const float was = distance(before[i], centre_before);
+            if (was > 1.0f) {
+                ratios.push_back(distance(after[i], centre_after) / was);
+            }
+        }
+        const float factor = ratios.empty() ? 1.0f : median(ratios);
+
+        const float cx = box.x + box.width / 2.0f + shift.x;
+        const float cy = box.y + box.height / 2.0f + shift.y;
+        const float width = box.width * factor;
+        const float height = box.height * factor;
+        box = cv::Rect(cvRound(cx - width / 2), cvRound(cy - height / 2),
+                       cvRound(width), cvRound(height));
+    }
+
+    static cv::Point2f centre(const std::vector<cv::Point2f> & points)
+    {
+        std::vector<float> xs, ys;
+        for (const auto & each : points) {
+            xs.push_back(each.x);
+            ys.push_back(each.y);
+        }
+        return cv::Point2f(median(xs), median(ys));
+    }
+
+    static float distance(const cv::Point2f & a, const cv::Point2f & b)
+    {
+        return std::sqrt((a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y));
+    }
+
+    static float median(std::vector<float> values)
+    {
+        auto middle = values.begin() + values.size() / 2;
+        std::nth_element(values.begin(), middle, values.end());
+        return *middle;
+    }
+
+    const tracker_settings settings_;
+    std::deque<std::pair<std::uint64_t, cv::Mat>> history_;
+    std::vector<target> tracked_;
+    std::vector<detection> fixed_;
+};
+
+}
+#endif
@@ -0,0 +1,232 @@
+#ifndef PIPELINE_BUFFER_POOL_HPP
+#define PIPELINE_BUFFER_POOL_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <boost/thread/mutex.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+namespace pipeline {
+
+/**
+ * \brief A fixed set of buffers which are lent and recycled.
+ * \class buffer_pool
+ *
+ * The buffers are created with the pool and \a acquire lends a free one
+ * as a lease. A lease is copied like a shared_ptr, with the count of its
+ * users inside the buffer: the buffer goes back to the pool when the last
+ * copy is gone, and keeps what it holds (e.g. the pixels of a cv::Mat),
+ * so the next user writes in the same memory. The free list has room for
+ * every buffer, so lending and giving back never allocate.
+ *
+ * When every buffer is lent \a acquire gives an empty lease and the
+ * caller allocates its own, which is counted in \a misses: the pool must
+ * cover the items of the queues and of the stages between them.
+ * Leases may outlive the pool, the buffers are freed with the last one.
+ */
+template <class T>
+class buffer_pool
+{
+    struct shared;
+
+    struct slot
+    {
+        T item;
+        std::atomic<unsigned int> users{0};
+        shared * owner = nullptr;
+    };
+
+    /// the buffers, owned by the pool and by every lease
+    struct shared
+    {
+        explicit shared(std::size_t size)
+        : size(size), slots(new slot[size]), owners(1)
+        {
+            free.reserve(size);
+            for (std::size_t i = 0; i < size; ++i) {
+                slots[i].owner = this;
+                free.push_back(&slots[i]);
+            }
+        }
+
+        void give_back(slot * each)
+        {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                free.push_back(each);
+            }
+            release();
+        }
+
+        void release()
+        {
+            if (--owners == 0) {
+                delete this;
+            }
+        }
+
+        const std::size_t size;
+        std::unique_ptr<slot[]> slots;
+        boost::mutex mutex;
+        std::vector<slot*> free;
+        std::atomic<std::size_t> owners;
+        std::atomic<std::uint64_t> acquired{0};
+        std::atomic<std::uint64_t> misses{0};
+    };
+
+public:
+    /// \brief a buffer of the pool, or nothing if the pool was empty
+    class lease
+    {
+    public:
+        lease() = default;
+
+        lease(const lease & other)
+        : slot_(other.slot_)
+        {
+            if (slot_) {
+                ++slot_->users;
+            }
+        }
+
+        lease(lease && other)
+        : slot_(other.slot_)
+        {
+            other.slot_ = nullptr;
+        }
+
+        lease & operator=(lease other)
+        {
+            std::swap(slot_, other.slot_);
+            return *this;
+        }
+
+        ~lease()
+        {
+            reset();
+        }
+
+        /// \brief stop using the buffer, which goes back to the pool with its last user
+        void reset()
+        {
+            if (slot_ && --slot_->users == 0) {
+                slot_->owner->give_back(slot_);
+            }
+            slot_ = nullptr;
+        }
+
+        explicit operator bool() const
+        {
+            return slot_ != nullptr;
+        }
+
+        T & operator*() const
+        {
+            return slot_->item;
+        }
+
+        T * operator->() const
+        {
+            return &slot_->item;
+        }
+
+    private:
+        friend class buffer_pool;
+
+        explicit lease(slot * each)
+        : slot_(each)
+        {}
+
+        slot * slot_ = nullptr;
+    };
+
+    explicit buffer_pool(std::size_t size)
+    : shared_(new shared(size))
+    {}
+
+    buffer_pool(const buffer_pool &) = delete;
+    buffer_pool & operator=(const buffer_pool &) = delete;
+
+    ~buffer_pool()
+    {
+        shared_->release();
+    }
+
+    /// \brief lend a free buffer, an empty lease if they are all lent
+    lease acquire()
+    {
+        slot * each = nullptr;
+        {
+            boost::unique_lock<boost::mutex> lock(shared_->mutex);
+            if (!shared_->free.empty()) {
+                each = shared_->free.back();
+                shared_->free.pop_back();
+            }
+        }
+        if (!each) {
+            ++shared_->misses;
+            return lease();
+        }
+        ++shared_->owners;
+        each->users = 1;
+        ++shared_->acquired;
+        return lease(each);
+    }
+
+    /// \brief number of buffers
+    std::size_t size() const
+    {
+        return shared_->size;
+    }
+
+    /// \brief buffers lent right now
+    std::size_t in_use() const
+    {
+        boost::unique_lock<boost::mutex> lock(shared_->mutex);
+        return shared_->size - shared_->free.size();
+    }
+
+    /// \brief leases given so far
+    std::uint64_t acquired() const
+    {
+        return shared_->acquired;
+    }
+
+    /// \brief calls to \a acquire which found every buffer lent
+    std::uint64_t misses() const
+    {
+        return shared_->misses;
+    }
+
+    /// \brief print the size of the pool, the leases and the misses
+    void print(std::ostream & out) const
+    {
+        out << "Buffer pool: " << size() << " buffers, " << in_use() << " in use, "
+            << acquired() << " leases, " << misses() << " misses" << std::endl;
+    }
+
+private:
+    shared * shared_;
+};
+
+}
+#endif
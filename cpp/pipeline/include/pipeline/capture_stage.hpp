@@ -0,0 +1,162 @@
+#ifndef PIPELINE_CAPTURE_STAGE_HPP
+#define PIPELINE_CAPTURE_STAGE_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/allocation_site.hpp>
+#include <pipeline/bounded_queue.hpp>
+#include <pipeline/change_detector.hpp>
+#include <pipeline/frame.hpp>
+#include <pipeline/latency.hpp>
+#include <pipeline/rate_controller.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <boost/chrono.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <atomic>
+#include <cstdint>
+
+namespace pipeline {
+
+/**
+ * \brief Reads the camera on its own thread.
+ * \class capture_stage
+ *
+ * Every frame is offered to the \a display queue, and a frame is offered
+ * to the \a upload queue whenever the \a rate controller allows a new
+ * cloud call and, when a \a changes detector is given, the scene has moved
+ * since the last upload: a static scene keeps the last detections and
+ * costs neither bandwidth nor platform time. Both hand-offs use
+ * push_newest: when a later stage is busy the frame waiting for it is
+ * replaced by the new one, so a slow platform reply never stalls the
+ * camera and the stage always gets the latest frame (with an upload
+ * queue of one, a mailbox). The replaced frames are counted in the
+ * \a dropped of the queues, the frames read in \a captured.
+ *
+ * With a \a pool the camera reads into a buffer of the pool, which is
+ * written again only once every frame holding it is gone, so in the
+ * steady state no image is allocated; a frame which finds every buffer
+ * lent gets a new one.
+ */
+class capture_stage
+{
+public:
+    capture_stage(cv::VideoCapture & camera,
+                  bounded_queue<frame> & upload,
+                  bounded_queue<frame> & display,
+                  rate_controller & rate,
+                  change_detector * changes = nullptr,
+                  frame_pool * pool = nullptr)
+    : camera_(camera), upload_(upload), display_(display), rate_(rate), changes_(changes),
+      pool_(pool), running_(true), thread_([this]{ run(); })
+    {}
+
+    /// \brief stop reading the camera and join the thread
+    ~capture_stage()
+    {
+        stop();
+    }
+
+    /// \brief frames read from the camera so far
+    std::uint64_t captured() const
+    {
+        return captured_;
+    }
+
+    void stop()
+    {
+        running_ = false;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+private:
+    void run()
+    {
+        allocation_scope site(allocation_site::frame_path);
+        std::uint64_t seq = 0;
+        while (running_) {
+            /*
+             * The camera must not write in a buffer which is still being
+             * encoded or displayed: without a pool, or when every buffer
+             * of the pool is lent, it reads into a new cv::Mat.
+             */
+            frame current;
+            if (pool_) {
+                current.buffer = pool_->acquire();
+                if (current.buffer) {
+                    current.image = *current.buffer;
+                }
+            }
+            bool grabbed;
+            {
+                allocation_scope reading(allocation_site::opencv);
+                span timing(capture_latency_);
+                grabbed = camera_.read(current.image);
+            }
+            if (!grabbed || current.image.empty()) {
+                boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+                continue;
+            }
+            if (current.buffer) {
+                // the first read (or a new size) allocates: keep the pixels for the next lease
+                *current.buffer = current.image;
+            }
+            current.seq = seq++;
+            current.captured = clock::now();
+            ++captured_;
+
+            if (rate_.ready(current.captured)) {
+                upload(current);
+            }
+            display_.push_newest(std::move(current));
+        }
+    }
+
+    void upload(const frame & current)
+    {
+        if (changes_) {
+            allocation_scope comparing(allocation_site::opencv);
+            span timing(change_latency_);
+            if (!changes_->changed(current.image, current.captured)) {
+                return;
+            }
+        }
+        if (upload_.push_newest(current)) {
+            rate_.sent(current.captured);
+            if (changes_) {
+                changes_->uploaded(current.captured);
+            }
+        }
+    }
+
+    cv::VideoCapture & camera_;
+    bounded_queue<frame> & upload_;
+    bounded_queue<frame> & display_;
+    rate_controller & rate_;
+    change_detector * changes_;
+    frame_pool * pool_;
+    histogram & capture_latency_ = latency().get("capture");
+    histogram & change_latency_ = latency().get("change");
+    std::atomic<std::uint64_t> captured_{0};
+    std::atomic<bool> running_;
+    boost::thread thread_;
+};
+
+}
+#endif
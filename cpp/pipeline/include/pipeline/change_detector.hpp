@@ -0,0 +1,126 @@
+#ifndef PIPELINE_CHANGE_DETECTOR_HPP
+#define PIPELINE_CHANGE_DETECTOR_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/clock.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <boost/chrono.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
+namespace pipeline {
+
+/**
+ * \brief Parameters of the change_detector.
+ */
+struct change_settings
+{
+    /// size of the luminance thumbnail which is compared
+    cv::Size thumbnail = cv::Size(32, 24);
+    /// a block changed when its luminance differs more than this (0 - 255)
+    int block_threshold = 10;
+    /// the scene changed when at least this fraction of the blocks changed
+    double min_changed = 0.005;
+    /// upload anyway after this time, so results never get too old
+    clock::duration refresh = boost::chrono::seconds(10);
+};
+
+/**
+ * \brief Cheap on-device test of whether the scene has moved.
+ * \class change_detector
+ *
+ * The frame is shrunk to a small thumbnail with area interpolation,
+ * so every pixel of the thumbnail is the mean of a block of the frame
+ * (which also removes most of the sensor noise), and converted to luminance.
+ * The thumbnail is compared block by block with the one of the last
+ * frame which was uploaded: comparing with the last upload, and not with
+ * the previous frame, means that slow changes still add up.
+ *
+ * The thumbnails are members, so once the first frames have been
+ * compared and uploaded nothing is allocated any more.
+ *
+ * Call \a changed before encoding and \a uploaded once the frame
+ * has actually been sent. It is meant to be used by a single thread,
+ * only \a skipped can be read from any thread.
+ */
+class change_detector
+{
+public:
+    explicit change_detector(change_settings settings = change_settings())
+    : settings_(settings)
+    {}
+
+    /// \brief true if \a image differs from the last uploaded frame
+    bool changed(const cv::Mat & image, clock::time_point now)
+    {
+        cv::resize(image, small_, settings_.thumbnail, 0, 0, cv::INTER_AREA);
+        if (small_.channels() == 3) {
+            cv::cvtColor(small_, candidate_, CV_BGR2GRAY);
+        }
+        else {
+            // a copy, not a header: small_ is written again by the next frame
+            small_.copyTo(candidate_);
+        }
+
+        if (reference_.empty() || now - last_upload_ >= settings_.refresh) {
+            return true;
+        }
+
+        int blocks = 0;
+        for (int y = 0; y < candidate_.rows; ++y) {
+            const uchar * a = candidate_.ptr<uchar>(y);
+            const uchar * b = reference_.ptr<uchar>(y);
+            for (int x = 0; x < candidate_.cols; ++x) {
+                if (std::abs(int(a[x]) - int(b[x])) > settings_.block_threshold) {
+                    ++blocks;
+                }
+            }
+        }
+        if (blocks < settings_.min_changed * candidate_.rows * candidate_.cols) {
+            ++skipped_;
+            return false;
+        }
+        return true;
+    }
+
+    /// \brief the frame last passed to \a changed has been uploaded at \a now
+    void uploaded(clock::time_point now)
+    {
+        cv::swap(reference_, candidate_);
+        last_upload_ = now;
+    }
+
+    /// \brief number of frames which were not uploaded because nothing moved
+    std::uint64_t skipped() const
+    {
+        return skipped_;
+    }
+
+private:
+    const change_settings settings_;
+    cv::Mat small_;
+    cv::Mat reference_;
+    cv::Mat candidate_;
+    clock::time_point last_upload_;
+    std::atomic<std::uint64_t> skipped_{0};
+};
+
+}
+#endif
@@ -0,0 +1,30 @@
+#ifndef PIPELINE_CLOCK_HPP
+#define PIPELINE_CLOCK_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <boost/chrono.hpp>
+
+namespace pipeline {
+
+/**
+ * \brief Monotonic clock used by every stage.
+ * The system clock can jump (NTP, manual changes), which would
+ * skew the intervals between calls, so we never use it for timing.
+ */
+typedef boost::chrono::steady_clock clock;
+
+}
+#endif
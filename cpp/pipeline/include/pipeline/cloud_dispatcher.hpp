@@ -0,0 +1,121 @@
+#ifndef PIPELINE_CLOUD_DISPATCHER_HPP
+#define PIPELINE_CLOUD_DISPATCHER_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/async_controller.hpp>
+#include <pipeline/bounded_queue.hpp>
+#include <pipeline/frame.hpp>
+#include <pipeline/latency.hpp>
+#include <pipeline/rate_controller.hpp>
+
+#include <rapp/cloud/service_controller.hpp>
+#include <rapp/objects/picture.hpp>
+
+#include <boost/thread/thread.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+
+namespace pipeline {
+
+/**
+ * \brief Sends encoded frames to the RAPP platform.
+ * \class cloud_dispatcher
+ *
+ * A thread takes the encoded frames and submits them to an async_controller,
+ * so up to \a window calls are on the wire at the same time while the
+ * camera and the encoders keep running. When the window is full the
+ * dispatcher waits, and the encoders wait for it.
+ * The \a call functor receives the controller of a worker, the picture
+ * and the sequence number of the frame, makes the actual cloud call and
+ * returns true if the platform replied (i.e. the callback was invoked).
+ * The encoded bytes are moved into the picture; pass it to make_call with
+ * std::cref, since make_call takes its arguments by value and would copy them.
+ * The latency of every call and its outcome are reported to \a rate,
+ * and recorded in latency() with the age of the frame when the call
+ * starts and when the reply arrives.
+ */
+class cloud_dispatcher
+{
+public:
+    typedef std::function<bool(rapp::cloud::service_controller &,
+                               const rapp::object::picture &,
+                               std::uint64_t)> call_function;
+
+    cloud_dispatcher(const rapp::cloud::platform & info,
+                     bounded_queue<encoded_frame> & input,
+                     unsigned int window,
+                     rate_controller & rate,
+                     call_function call)
+    : input_(input), rate_(rate), call_(call), ctrl_(info, window),
+      thread_([this]{ run(); })
+    {}
+
+    /// \brief the controllers used for the calls, with their counters
+    const controller_pool & controllers() const
+    {
+        return ctrl_.controllers();
+    }
+
+    /// \brief close the input queue, wait for the calls in flight and join the thread
+    ~cloud_dispatcher()
+    {
+        input_.close();
+        thread_.join();
+    }
+
+private:
+    void run()
+    {
+        encoded_frame job;
+        while (input_.pop(job)) {
+            auto pic = std::make_shared<rapp::object::picture>(std::move(job.bytes));
+            const std::uint64_t seq = job.seq;
+            const clock::time_point captured = job.captured;
+            ctrl_.submit([this, pic, seq, captured](rapp::cloud::service_controller & ctrl) {
+                const auto start = clock::now();
+                call_age_.record(start - captured);
+                bool replied = false;
+                try {
+                    replied = call_(ctrl, *pic, seq);
+                }
+                catch (...) {
+                    rate_.completed(clock::now() - start, false);
+                    throw;
+                }
+                const auto now = clock::now();
+                rate_.completed(now - start, replied);
+                call_latency_.record(now - start);
+                frame_latency_.record(now - captured);
+                return replied;
+            });
+        }
+    }
+
+    bounded_queue<encoded_frame> & input_;
+    rate_controller & rate_;
+    call_function call_;
+    histogram & call_latency_ = latency().get("call");
+    histogram & call_age_ = latency().get("capture_to_call");
+    histogram & frame_latency_ = latency().get("capture_to_reply");
+    async_controller ctrl_;
+    boost::thread thread_;
+};
+
+}
+#endif
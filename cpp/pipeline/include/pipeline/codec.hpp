@@ -0,0 +1,184 @@
+#ifndef PIPELINE_CODEC_HPP
+#define PIPELINE_CODEC_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <opencv2/opencv.hpp>
+#include <rapp/cloud/vision_detection.hpp>
+#include <rapp/cloud/vision_recognition.hpp>
+
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace pipeline {
+
+/*
+ * cv::imencode writes a std::vector<uchar>: when it is the same type that
+ * rapp::object::picture keeps, we can encode straight into the buffer
+ * which is moved into the picture, without any copy.
+ */
+static_assert(std::is_same<rapp::types::byte, uchar>::value,
+              "rapp::types::byte must be the byte type of cv::imencode");
+
+/**
+ * \brief How a frame is encoded before it is sent to the platform.
+ * \class codec
+ *
+ * PNG is lossless but slow (tens of ms for a 640x480 frame on the
+ * Atom of NAO) and large; JPEG is much faster and smaller;
+ * BMP has no compression at all and costs nothing but bandwidth.
+ * Any of them can drop the colour, which divides the data by three
+ * for services which only look at the luminance.
+ */
+class codec
+{
+public:
+    enum format_type { png, jpeg, bmp };
+
+    /// \brief PNG with compression \a level (0 - 9)
+    static codec make_png(int level, bool grayscale = false)
+    {
+        return codec(png, level, grayscale);
+    }
+
+    /// \brief JPEG with \a quality (0 - 100)
+    static codec make_jpeg(int quality, bool grayscale = false)
+    {
+        return codec(jpeg, quality, grayscale);
+    }
+
+    /// \brief uncompressed BMP
+    static codec make_bmp(bool grayscale = false)
+    {
+        return codec(bmp, 0, grayscale);
+    }
+
+    /// \brief encode \a image into \a buf, which can be moved into a rapp::object::picture
+    void encode(const cv::Mat & image, std::vector<rapp::types::byte> & buf) const
+    {
+        cv::Mat gray;
+        encode(image, buf, gray);
+    }
+
+    /**
+     * \brief encode \a image into \a buf, converting it to grayscale in \a scratch.
+     * A thread which keeps \a scratch between frames converts without allocating.
+     */
+    void encode(const cv::Mat & image, std::vector<rapp::types::byte> & buf, cv::Mat & scratch) const
+    {
+        if (grayscale_ && image.channels() == 3) {
+            cv::cvtColor(image, scratch, CV_BGR2GRAY);
+            cv::imencode(extension(), scratch, buf, params_);
+        }
+        else {
+            cv::imencode(extension(), image, buf, params_);
+        }
+    }
+
+    /// \brief extension given to cv::imencode
+    std::string extension() const
+    {
+        switch (format_) {
+            case png:  return ".png";
+            case jpeg: return ".jpg";
+            default:   return ".bmp";
+        }
+    }
+
+    /// \brief short description, e.g. "jpeg 85 gray"
+    std::string name() const
+    {
+        std::string result = extension().substr(1);
+        if (format_ != bmp) {
+            result += " " + std::to_string(value_);
+        }
+        if (grayscale_) {
+            result += " gray";
+        }
+        return result;
+    }
+
+    format_type format() const
+    {
+        return format_;
+    }
+
+    bool grayscale() const
+    {
+        return grayscale_;
+    }
+
+private:
+    codec(format_type format, int value, bool grayscale)
+    : format_(format), value_(value), grayscale_(grayscale)
+    {
+        if (format_ == png) {
+            params_ = {CV_IMWRITE_PNG_COMPRESSION, value_};
+        }
+        else if (format_ == jpeg) {
+            params_ = {CV_IMWRITE_JPEG_QUALITY, value_};
+        }
+    }
+
+    format_type format_;
+    int value_;
+    bool grayscale_;
+    std::vector<int> params_;
+};
+
+/**
+ * \brief Codec used for each cloud service unless the tutorial chooses another one.
+ * Face and human detection work on luminance and don't need a lossless image,
+ * object recognition keeps the colour.
+ */
+template <class Service>
+struct default_codec
+{
+    static codec get()
+    {
+        return codec::make_png(3);
+    }
+};
+
+template <>
+struct default_codec<rapp::cloud::face_detection>
+{
+    static codec get()
+    {
+        return codec::make_jpeg(85, true);
+    }
+};
+
+template <>
+struct default_codec<rapp::cloud::human_detection>
+{
+    static codec get()
+    {
+        return codec::make_jpeg(85, true);
+    }
+};
+
+template <>
+struct default_codec<rapp::cloud::object_recognition>
+{
+    static codec get()
+    {
+        return codec::make_jpeg(90);
+    }
+};
+
+}
+#endif
@@ -0,0 +1,140 @@
+#ifndef PIPELINE_CONTROLLER_POOL_HPP
+#define PIPELINE_CONTROLLER_POOL_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <rapp/cloud/service_controller.hpp>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+namespace pipeline {
+
+/**
+ * \brief Reusable cloud controllers for repeated calls to one platform.
+ * \class controller_pool
+ *
+ * The pool creates \a size controllers once and lends them for each
+ * call: \a acquire waits until one is free and the lease gives it back
+ * when it goes out of scope. This bounds the controllers to the calls in
+ * flight, nothing more: the connections don't change. With librapp 0.7
+ * every `make_call` opens its own socket (and negotiates TLS), whichever
+ * controller makes it; keep-alive and TLS session resumption need support
+ * in the library. \a print gives the calls and the controllers, not
+ * connections saved.
+ */
+class controller_pool
+{
+public:
+    /// \brief a controller lent by the pool, returned when the lease is destroyed
+    class lease
+    {
+    public:
+        lease(lease && other)
+        : pool_(other.pool_), ctrl_(other.ctrl_)
+        {
+            other.pool_ = nullptr;
+        }
+
+        ~lease()
+        {
+            if (pool_) {
+                pool_->release(ctrl_);
+            }
+        }
+
+        lease(const lease &) = delete;
+        lease & operator=(const lease &) = delete;
+        lease & operator=(lease &&) = delete;
+
+        rapp::cloud::service_controller & operator*() const { return *ctrl_; }
+        rapp::cloud::service_controller * operator->() const { return ctrl_; }
+
+    private:
+        friend class controller_pool;
+
+        lease(controller_pool * pool, rapp::cloud::service_controller * ctrl)
+        : pool_(pool), ctrl_(ctrl)
+        {}
+
+        controller_pool * pool_;
+        rapp::cloud::service_controller * ctrl_;
+    };
+
+    controller_pool(const rapp::cloud::platform & info, unsigned int size)
+    {
+        for (unsigned int i = 0; i < size; ++i) {
+            owned_.emplace_back(new rapp::cloud::service_controller(info));
+            free_.push_back(owned_.back().get());
+        }
+    }
+
+    controller_pool(const controller_pool &) = delete;
+    controller_pool & operator=(const controller_pool &) = delete;
+
+    /// \brief lend a controller for one call, waiting until one is free
+    lease acquire()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while (free_.empty()) {
+            returned_.wait(lock);
+        }
+        rapp::cloud::service_controller * ctrl = free_.back();
+        free_.pop_back();
+        ++calls_;
+        return lease(this, ctrl);
+    }
+
+    /// \brief number of controllers created
+    std::size_t controllers() const
+    {
+        return owned_.size();
+    }
+
+    /// \brief number of calls made with the controllers of the pool
+    std::uint64_t calls() const
+    {
+        return calls_;
+    }
+
+    /// \brief print the counters in one line
+    void print(std::ostream & out) const
+    {
+        out << calls() << " calls with " << controllers() << " controllers, one connection per call" << std::endl;
+    }
+
+private:
+    void release(rapp::cloud::service_controller * ctrl)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        free_.push_back(ctrl);
+        returned_.notify_one();
+    }
+
+    std::vector<std::unique_ptr<rapp::cloud::service_controller>> owned_;
+    std::vector<rapp::cloud::service_controller*> free_;
+    boost::mutex mutex_;
+    boost::condition_variable returned_;
+    std::atomic<std::uint64_t> calls_{0};
+};
+
+}
+#endif
@@ -0,0 +1,115 @@
+#ifndef PIPELINE_DISPLAY_STAGE_HPP
+#define PIPELINE_DISPLAY_STAGE_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/clock.hpp>
+#include <pipeline/stop_signal.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <boost/chrono.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pipeline {
+
+/**
+ * \brief A window of the display: its name, and a function which gives
+ * the next image to show, or false if there isn't a new one.
+ */
+struct view
+{
+    std::string name;
+    std::function<bool(cv::Mat &)> next;
+};
+
+/**
+ * \brief Shows the views in HighGUI windows from a thread of its own.
+ * \class display_stage
+ *
+ * It refreshes the windows at most \a max_fps times per second and only
+ * waits 1 ms in cv::waitKey, so the display is an optional consumer and
+ * never slows down the rest of the pipeline. Every HighGUI call is made
+ * in this thread. A key pressed in a window requests the \a stop.
+ *
+ * Build with PIPELINE_HEADLESS to leave HighGUI out: then the stage does
+ * nothing and \a available is false.
+ */
+class display_stage
+{
+public:
+    display_stage(std::vector<view> views, stop_signal & stop, double max_fps = 15)
+    : views_(std::move(views)), stop_(stop),
+      period_(boost::chrono::duration_cast<clock::duration>(boost::chrono::duration<double>(1.0 / max_fps))),
+      running_(true), thread_([this]{ run(); })
+    {}
+
+    ~display_stage()
+    {
+        running_ = false;
+        thread_.join();
+    }
+
+    /// \brief false if the program was built without HighGUI (PIPELINE_HEADLESS)
+    static bool available()
+    {
+#ifdef PIPELINE_HEADLESS
+        return false;
+#else
+        return true;
+#endif
+    }
+
+private:
+    void run()
+    {
+#ifndef PIPELINE_HEADLESS
+        for (const auto & each : views_) {
+            cv::namedWindow(each.name, cv::WINDOW_AUTOSIZE);
+        }
+        auto next = clock::now();
+        cv::Mat image;
+        while (running_) {
+            for (const auto & each : views_) {
+                if (each.next(image)) {
+                    cv::imshow(each.name, image);
+                }
+            }
+            if (cv::waitKey(1) >= 0) {
+                stop_.request();
+            }
+            next = std::max(next + period_, clock::now());
+            boost::this_thread::sleep_until(next);
+        }
+        cv::destroyAllWindows();
+#endif
+    }
+
+    const std::vector<view> views_;
+    stop_signal & stop_;
+    const clock::duration period_;
+    std::atomic<bool> running_;
+    boost::thread thread_;
+};
+
+}
+#endif
@@ -0,0 +1,106 @@
+#ifndef PIPELINE_ENCODE_POOL_HPP
+#define PIPELINE_ENCODE_POOL_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/allocation_site.hpp>
+#include <pipeline/bounded_queue.hpp>
+#include <pipeline/codec.hpp>
+#include <pipeline/frame.hpp>
+#include <pipeline/latency.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <boost/thread/thread.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace pipeline {
+
+/**
+ * \brief A pool of threads which encode frames for the platform.
+ * \class encode_pool
+ *
+ * Workers take frames from \a input, encode them with the \a format codec
+ * straight into the buffer of the encoded_frame (which is later moved
+ * into the rapp::object::picture, so the bytes are never copied)
+ * and wait for room in \a output, which lets the cloud dispatcher
+ * push back on the encoders without ever reaching the camera.
+ * Every worker keeps its grayscale image between frames; the buffer of
+ * the bytes is the only allocation left per frame, since the picture
+ * keeps it, with the ones OpenCV makes to encode (allocation_site::codec).
+ */
+class encode_pool
+{
+public:
+    encode_pool(bounded_queue<frame> & input,
+                bounded_queue<encoded_frame> & output,
+                unsigned int workers,
+                codec format)
+    : input_(input), output_(output), format_(format)
+    {
+        for (unsigned int i = 0; i < workers; ++i) {
+            threads_.create_thread([this]{ run(); });
+        }
+    }
+
+    /// \brief close the input queue, encode what is left and join the workers
+    ~encode_pool()
+    {
+        input_.close();
+        threads_.join_all();
+    }
+
+private:
+    void run()
+    {
+        allocation_scope site(allocation_site::frame_path);
+        frame current;
+        cv::Mat gray;
+        std::size_t last_size = 0;
+        while (input_.pop(current)) {
+            encoded_frame job;
+            job.seq = current.seq;
+            job.captured = current.captured;
+            /*
+             * Consecutive frames have similar sizes: reserving a bit more
+             * than the last one means a single allocation per frame
+             * instead of the vector growing while it is encoded.
+             */
+            {
+                allocation_scope codec_site(allocation_site::codec);
+                job.bytes.reserve(last_size + last_size / 8);
+                span timing(encode_latency_);
+                format_.encode(current.image, job.bytes, gray);
+            }
+            // give the image back to the pool of the camera before waiting for room
+            current = frame();
+            last_size = job.bytes.size();
+            if (!output_.push(std::move(job))) {
+                break;
+            }
+        }
+    }
+
+    bounded_queue<frame> & input_;
+    bounded_queue<encoded_frame> & output_;
+    const codec format_;
+    histogram & encode_latency_ = latency().get("encode");
+    boost::thread_group threads_;
+};
+
+}
+#endif
@@ -0,0 +1,172 @@
+#ifndef PIPELINE_FANOUT_DISPATCHER_HPP
+#define PIPELINE_FANOUT_DISPATCHER_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/async_controller.hpp>
+#include <pipeline/bounded_queue.hpp>
+#include <pipeline/clock.hpp>
+#include <pipeline/frame.hpp>
+#include <pipeline/latency.hpp>
+#include <pipeline/rate_controller.hpp>
+
+#include <rapp/cloud/service_controller.hpp>
+#include <rapp/objects/picture.hpp>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pipeline {
+
+/**
+ * \brief A cloud service called by the fanout_dispatcher.
+ * \a call makes the call with the controller and the picture it receives,
+ * adds what it found to the detections and returns true if the platform replied.
+ */
+struct service
+{
+    typedef std::function<bool(rapp::cloud::service_controller &,
+                               const rapp::object::picture &,
+                               std::vector<detection> &)> call_function;
+
+    std::string name;
+    call_function call;
+};
+
+/**
+ * \brief Sends every encoded frame to several cloud services at once.
+ * \class fanout_dispatcher
+ *
+ * The frame is captured and encoded once, and the same picture is given
+ * to every service; the calls run at the same time in an async_controller.
+ * When all the services of a frame have finished, \a on_merged gets the
+ * number of the frame and the detections of all of them together,
+ * on the thread of the last call.
+ * Up to \a window frames are in flight, so up to \a window times the
+ * number of services calls. The rate controller sees one call per frame,
+ * as long as the slowest service, which failed if any service failed.
+ */
+class fanout_dispatcher
+{
+public:
+    typedef std::function<void(std::uint64_t, std::vector<detection>)> merged_function;
+
+    fanout_dispatcher(const rapp::cloud::platform & info,
+                      bounded_queue<encoded_frame> & input,
+                      unsigned int window,
+                      rate_controller & rate,
+                      std::vector<service> services,
+                      merged_function on_merged)
+    : input_(input), rate_(rate), services_(std::move(services)), on_merged_(on_merged),
+      ctrl_(info, window * static_cast<unsigned int>(services_.size())),
+      thread_([this]{ run(); })
+    {}
+
+    /// \brief close the input queue, wait for the calls in flight and join the thread
+    ~fanout_dispatcher()
+    {
+        input_.close();
+        thread_.join();
+    }
+
+    /// \brief the controllers used for the calls, with their counters
+    const controller_pool & controllers() const
+    {
+        return ctrl_.controllers();
+    }
+
+private:
+    /// \brief the services of one frame which are still running, and what they found
+    struct pending
+    {
+        std::uint64_t seq;
+        clock::time_point captured;
+        clock::time_point start;
+        boost::mutex mutex;
+        std::size_t remaining;
+        bool replied = true;
+        std::vector<detection> merged;
+    };
+
+    void run()
+    {
+        encoded_frame job;
+        while (input_.pop(job)) {
+            if (services_.empty()) {
+                continue;
+            }
+            auto pic = std::make_shared<rapp::object::picture>(std::move(job.bytes));
+            auto state = std::make_shared<pending>();
+            state->seq = job.seq;
+            state->captured = job.captured;
+            state->start = clock::now();
+            state->remaining = services_.size();
+
+            for (const auto & each : services_) {
+                auto call = each.call;
+                ctrl_.submit([this, pic, state, call](rapp::cloud::service_controller & ctrl) {
+                    std::vector<detection> found;
+                    bool replied = false;
+                    try {
+                        replied = call(ctrl, *pic, found);
+                    }
+                    catch (...) {
+                        finish(*state, false, found);
+                        throw;
+                    }
+                    finish(*state, replied, found);
+                    return replied;
+                });
+            }
+        }
+    }
+
+    /// \brief add the result of one service, and merge the frame after the last one
+    void finish(pending & state, bool replied, std::vector<detection> & found)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(state.mutex);
+            state.replied = state.replied && replied;
+            state.merged.insert(state.merged.end(), found.begin(), found.end());
+            if (--state.remaining > 0) {
+                return;
+            }
+        }
+        const auto now = clock::now();
+        rate_.completed(now - state.start, state.replied);
+        call_latency_.record(now - state.start);
+        frame_latency_.record(now - state.captured);
+        on_merged_(state.seq, std::move(state.merged));
+    }
+
+    bounded_queue<encoded_frame> & input_;
+    rate_controller & rate_;
+    const std::vector<service> services_;
+    merged_function on_merged_;
+    histogram & call_latency_ = latency().get("call");
+    histogram & frame_latency_ = latency().get("capture_to_reply");
+    async_controller ctrl_;
+    boost::thread thread_;
+};
+
+}
+#endif
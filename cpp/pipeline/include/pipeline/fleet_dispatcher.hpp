@@ -0,0 +1,279 @@
+#ifndef PIPELINE_FLEET_DISPATCHER_HPP
+#define PIPELINE_FLEET_DISPATCHER_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/change_detector.hpp>
+#include <pipeline/clock.hpp>
+#include <pipeline/codec.hpp>
+#include <pipeline/controller_pool.hpp>
+#include <pipeline/frame.hpp>
+#include <pipeline/frame_source.hpp>
+#include <pipeline/latency.hpp>
+#include <pipeline/rate_controller.hpp>
+
+#include <rapp/cloud/service_controller.hpp>
+#include <rapp/objects/picture.hpp>
+
+#include <boost/chrono.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+namespace pipeline {
+
+/// \brief how many workers the fleet has and how every source is paced
+struct fleet_settings
+{
+    /// calls made at the same time, by default one per core (at least 2)
+    unsigned int workers = std::max(2u, boost::thread::hardware_concurrency());
+    /// every source has its own rate controller with these settings
+    rate_settings rate;
+    /// every source has its own change detector with these settings
+    change_settings changes;
+    /// give the call a copy of the uploaded frame (e.g. to draw on it)
+    bool keep_frames = false;
+};
+
+/**
+ * \brief Sends the frames of many sources (cameras, robots, recordings) to the platform.
+ * \class fleet_dispatcher
+ *
+ * One process serves a fleet: every source is a frame_source, with its own
+ * rate controller and change detector. A pool of workers, one per core,
+ * looks for sources whose next call is due; a worker first serves its own
+ * sources, round-robin, and steals from the others when they are idle.
+ * The worker takes the newest frame with \a visit, encodes it in place,
+ * and makes the call, so the frames are encoded on all the cores and
+ * never wait in a queue.
+ * A source never has more than one call in flight: a slow robot slows down
+ * its own rate (back-pressure) but can't take the workers of the others.
+ *
+ * \a call receives the controller, the picture, the index of the source
+ * and the frame (with an empty image unless \a keep_frames), and returns
+ * true if the platform replied.
+ */
+class fleet_dispatcher
+{
+public:
+    typedef std::function<bool(rapp::cloud::service_controller &,
+                               const rapp::object::picture &,
+                               std::size_t,
+                               const frame &)> call_function;
+
+    fleet_dispatcher(const rapp::cloud::platform & info,
+                     std::vector<frame_source*> sources,
+                     codec format,
+                     call_function call,
+                     fleet_settings settings = fleet_settings())
+    : format_(format), call_(call), settings_(settings),
+      controllers_(info, settings.workers), running_(true)
+    {
+        for (auto each : sources) {
+            lanes_.emplace_back(new lane(each, settings_));
+        }
+        for (unsigned int i = 0; i < settings_.workers; ++i) {
+            threads_.create_thread([this, i]{ run(i); });
+        }
+    }
+
+    /// \brief let the calls in flight finish and join the workers
+    ~fleet_dispatcher()
+    {
+        running_ = false;
+        threads_.join_all();
+    }
+
+    fleet_dispatcher(const fleet_dispatcher &) = delete;
+    fleet_dispatcher & operator=(const fleet_dispatcher &) = delete;
+
+    /// \brief the controllers used for the calls, with their counters
+    const controller_pool & controllers() const
+    {
+        return controllers_;
+    }
+
+    /// \brief print the calls, the replies, the unchanged frames and the rate of every source
+    void print(std::ostream & out) const
+    {
+        for (std::size_t i = 0; i < lanes_.size(); ++i) {
+            const lane & each = *lanes_[i];
+            out << "source " << i << ": " << each.sent << " calls, "
+                << each.replied << " replies, " << each.changes.skipped()
+                << " unchanged, " << each.rate.rate() << " calls/s" << std::endl;
+        }
+    }
+
+private:
+    /// \brief a source and everything that paces it
+    struct lane
+    {
+        lane(frame_source * src, const fleet_settings & settings)
+        : source(src), rate(settings.rate), changes(settings.changes)
+        {}
+
+        frame_source * source;
+        rate_controller rate;
+        change_detector changes;
+        std::atomic<bool> busy{false};
+        std::atomic<std::uint64_t> sent{0};
+        std::atomic<std::uint64_t> replied{0};
+        std::size_t last_size = 0;
+    };
+
+    void run(unsigned int id)
+    {
+        std::size_t cursor = id;
+        while (running_) {
+            const std::size_t picked = claim(id, cursor);
+            if (picked == lanes_.size()) {
+                boost::this_thread::sleep_for(boost::chrono::milliseconds(5));
+                continue;
+            }
+            cursor = picked + 1;
+            // the source is given back whatever serve throws
+            const release_lane guard{*lanes_[picked]};
+            try {
+                serve(picked);
+            }
+            catch (const std::exception & e) {
+                std::cerr << "serving a source failed: " << e.what() << std::endl;
+            }
+            catch (...) {
+                std::cerr << "serving a source failed" << std::endl;
+            }
+        }
+    }
+
+    /// \brief marks a claimed source free again when it goes out of scope
+    struct release_lane
+    {
+        lane & claimed;
+
+        ~release_lane()
+        {
+            claimed.busy = false;
+        }
+    };
+
+    /**
+     * \brief claim a source whose call is due, starting from \a cursor:
+     * first the sources of this worker, then the others.
+     * Returns the number of sources if there is none.
+     */
+    std::size_t claim(unsigned int id, std::size_t cursor)
+    {
+        const std::size_t count = lanes_.size();
+        for (int steal = 0; steal < 2; ++steal) {
+            for (std::size_t k = 0; k < count; ++k) {
+                const std::size_t i = (cursor + k) % count;
+                if (!steal && i % settings_.workers != id) {
+                    continue;
+                }
+                lane & each = *lanes_[i];
+                if (!each.rate.ready(clock::now()) || each.busy.exchange(true)) {
+                    continue;
+                }
+                /* another worker may have served it since we looked */
+                if (each.rate.ready(clock::now())) {
+                    return i;
+                }
+                each.busy = false;
+            }
+        }
+        return count;
+    }
+
+    /// \brief take the newest frame of source \a index, encode it and make the call
+    void serve(std::size_t index)
+    {
+        lane & each = *lanes_[index];
+        const auto now = clock::now();
+        each.rate.sent(now);
+
+        std::vector<rapp::types::byte> bytes;
+        frame shot;
+        each.source->visit([&](const frame & latest) {
+            bool changed;
+            {
+                span timing(change_latency_);
+                changed = each.changes.changed(latest.image, now);
+            }
+            if (!changed) {
+                return;
+            }
+            bytes.reserve(each.last_size + each.last_size / 8);
+            span timing(encode_latency_);
+            format_.encode(latest.image, bytes);
+            each.last_size = bytes.size();
+            shot.seq = latest.seq;
+            shot.captured = latest.captured;
+            if (settings_.keep_frames) {
+                shot.image = latest.image.clone();
+            }
+        });
+        if (bytes.empty()) {
+            return;
+        }
+        each.changes.uploaded(now);
+
+        rapp::object::picture pic(std::move(bytes));
+        auto ctrl = controllers_.acquire();
+        const auto start = clock::now();
+        bool ok = false;
+        try {
+            ok = call_(*ctrl, pic, index, shot);
+        }
+        catch (const std::exception & e) {
+            std::cerr << "cloud call failed: " << e.what() << std::endl;
+        }
+        catch (...) {
+            std::cerr << "cloud call failed" << std::endl;
+        }
+        const auto done = clock::now();
+        each.rate.completed(done - start, ok);
+        call_latency_.record(done - start);
+        frame_latency_.record(done - shot.captured);
+        ++each.sent;
+        if (ok) {
+            ++each.replied;
+        }
+    }
+
+    const codec format_;
+    call_function call_;
+    const fleet_settings settings_;
+    std::vector<std::unique_ptr<lane>> lanes_;
+    controller_pool controllers_;
+    histogram & change_latency_ = latency().get("change");
+    histogram & encode_latency_ = latency().get("encode");
+    histogram & call_latency_ = latency().get("call");
+    histogram & frame_latency_ = latency().get("capture_to_reply");
+    std::atomic<bool> running_;
+    boost::thread_group threads_;
+};
+
+}
+#endif
@@ -0,0 +1,103 @@
+#ifndef PIPELINE_FRAME_HPP
+#define PIPELINE_FRAME_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/bounded_queue.hpp>
+#include <pipeline/buffer_pool.hpp>
+#include <pipeline/clock.hpp>
+
+#include <opencv2/opencv.hpp>
+#include <rapp/objects/picture.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace pipeline {
+
+/// \brief the images of a camera, written again once no frame holds them
+typedef buffer_pool<cv::Mat> frame_pool;
+
+/**
+ * \brief A frame taken from the camera.
+ * Every frame carries a sequence number so that results which
+ * come back from the platform can be matched with the image they describe.
+ */
+struct frame
+{
+    /// position of the frame in the capture stream
+    std::uint64_t seq = 0;
+    /// time at which the frame was read from the camera
+    clock::time_point captured;
+    /// image data (never modified once captured)
+    cv::Mat image;
+    /// buffer of a frame_pool the image was read into, empty if it was allocated
+    frame_pool::lease buffer;
+};
+
+/**
+ * \brief A frame after it has been encoded for the platform.
+ */
+struct encoded_frame
+{
+    /// sequence number of the source frame
+    std::uint64_t seq = 0;
+    /// time at which the source frame was read from the camera
+    clock::time_point captured;
+    /// encoded image (e.g. PNG) ready to be wrapped in a rapp::object::picture
+    std::vector<rapp::types::byte> bytes;
+};
+
+/**
+ * \brief A single detection returned by the platform, in frame coordinates.
+ * Services which only return a label (object recognition) leave \a box empty.
+ */
+struct detection
+{
+    cv::Rect box;
+    std::string label;
+};
+
+/**
+ * \brief Convert the objects returned by a rapp detection service
+ * (rapp::object::face, rapp::object::human) into detections.
+ */
+template <class T>
+std::vector<detection> boxes(const std::vector<T> & objects)
+{
+    std::vector<detection> result;
+    result.reserve(objects.size());
+    for (const auto & each : objects) {
+        cv::Point top_left(each.get_left_x(), each.get_left_y());
+        cv::Point bottom_right(each.get_right_x(), each.get_right_y());
+        result.push_back({cv::Rect(top_left, bottom_right), std::string()});
+    }
+    return result;
+}
+
+/// \brief drop the frames (or encoded frames) of \a queue which are older than \a max_age when they reach its front
+template <class Item>
+void drop_older_than(bounded_queue<Item> & queue, clock::duration max_age)
+{
+    if (max_age > clock::duration::zero()) {
+        queue.drop_when([max_age](const Item & item) {
+            return clock::now() - item.captured > max_age;
+        });
+    }
+}
+
+}
+#endif
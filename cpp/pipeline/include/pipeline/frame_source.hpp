@@ -0,0 +1,99 @@
+#ifndef PIPELINE_FRAME_SOURCE_HPP
+#define PIPELINE_FRAME_SOURCE_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/frame.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <boost/thread/mutex.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+namespace pipeline {
+
+/**
+ * \brief A camera which keeps streaming and can be asked for its newest frame.
+ * \class frame_source
+ */
+class frame_source
+{
+public:
+    virtual ~frame_source() {}
+
+    /// \brief copy the newest frame in \a out, false if there isn't any yet
+    virtual bool latest(frame & out) = 0;
+
+    /**
+     * \brief call \a use with the newest frame, false if there isn't any yet.
+     * The image is only valid during the call: sources which lend their
+     * own buffers (e.g. nao_camera in local mode) give it back afterwards,
+     * so clone it if it has to live longer.
+     */
+    virtual bool visit(const std::function<void(const frame &)> & use)
+    {
+        frame current;
+        if (!latest(current)) {
+            return false;
+        }
+        use(current);
+        return true;
+    }
+};
+
+/**
+ * \brief Keeps the newest frame of a source which runs its own thread.
+ * \class streaming_source
+ *
+ * Derived sources call \a publish with a new cv::Mat for every frame, or
+ * with the buffer of a frame_pool it was read into, and never write in it
+ * again while a frame holds it, so \a latest only copies the header of the image.
+ * Consumers must not draw in the image either: they have to clone it first.
+ */
+class streaming_source : public frame_source
+{
+public:
+    bool latest(frame & out) override
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        if (latest_.image.empty()) {
+            return false;
+        }
+        out = latest_;
+        return true;
+    }
+
+protected:
+    /// \brief make \a image, read into \a buffer if it is pooled, the newest frame
+    void publish(cv::Mat image, frame_pool::lease buffer = frame_pool::lease())
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        latest_.seq = seq_++;
+        latest_.captured = clock::now();
+        latest_.image = image;
+        latest_.buffer = std::move(buffer);
+    }
+
+private:
+    boost::mutex mutex_;
+    frame latest_;
+    std::uint64_t seq_ = 0;
+};
+
+}
+#endif
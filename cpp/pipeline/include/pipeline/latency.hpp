@@ -0,0 +1,336 @@
+#ifndef PIPELINE_LATENCY_HPP
+#define PIPELINE_LATENCY_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/clock.hpp>
+
+#include <boost/chrono.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pipeline {
+
+/**
+ * \brief Lock-free histogram of durations, in microseconds.
+ * \class histogram
+ *
+ * Log-linear buckets as in HDR histograms: values below 32 us have a
+ * bucket each, and every power of two above is split in 16 buckets,
+ * so every value is kept with an error below 1/16 (about 6%) from
+ * 1 us up to 12 days. Recording is a relaxed atomic increment, so any
+ * thread can record on the hot path without locks.
+ */
+class histogram
+{
+public:
+    histogram()
+    {
+        for (auto & each : counts_) {
+            each = 0;
+        }
+    }
+
+    histogram(const histogram &) = delete;
+    histogram & operator=(const histogram &) = delete;
+
+    /// \brief record \a elapsed
+    void record(clock::duration elapsed)
+    {
+        const auto us = boost::chrono::duration_cast<boost::chrono::microseconds>(elapsed).count();
+        record_us(us > 0 ? static_cast<std::uint64_t>(us) : 0);
+    }
+
+    void record_us(std::uint64_t us)
+    {
+        counts_[index(us)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(us, std::memory_order_relaxed);
+        std::uint64_t seen = max_.load(std::memory_order_relaxed);
+        while (us > seen && !max_.compare_exchange_weak(seen, us, std::memory_order_relaxed)) {
+        }
+    }
+
+    std::uint64_t count() const
+    {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    /// \brief mean in microseconds
+    double mean() const
+    {
+        const std::uint64_t n = count();
+        return n > 0 ? double(sum_.load(std::memory_order_relaxed)) / n : 0.0;
+    }
+
+    std::uint64_t max() const
+    {
+        return max_.load(std::memory_order_relaxed);
+    }
+
+    /// \brief value below which \a fraction of the values are (e.g. 0.99), in microseconds
+    std::uint64_t percentile(double fraction) const
+    {
+        std::uint64_t total = 0;
+        for (const auto & each : counts_) {
+            total += each.load(std::memory_order_relaxed);
+        }
+        if (total == 0) {
+            return 0;
+        }
+        const double rank = fraction * total;
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < buckets; ++i) {
+            seen += counts_[i].load(std::memory_order_relaxed);
+            if (seen >= rank && seen > 0) {
+                return std::min(upper(i), max());
+            }
+        }
+        return max();
+    }
+
+    /// \brief forget every value
+    void reset()
+    {
+        for (auto & each : counts_) {
+            each.store(0, std::memory_order_relaxed);
+        }
+        count_ = 0;
+        sum_ = 0;
+        max_ = 0;
+    }
+
+private:
+    static const unsigned int linear = 32;
+    static const unsigned int steps = 16;
+    static const unsigned int top_bit = 40;
+    static const std::size_t buckets = linear + (top_bit - 5) * steps;
+
+    static std::size_t index(std::uint64_t us)
+    {
+        if (us < linear) {
+            return static_cast<std::size_t>(us);
+        }
+        unsigned int bit = 63 - static_cast<unsigned int>(__builtin_clzll(us));
+        if (bit >= top_bit) {
+            return buckets - 1;
+        }
+        const unsigned int shift = bit - 4;
+        const std::uint64_t mantissa = us >> shift;
+        return linear + (bit - 5) * steps + static_cast<std::size_t>(mantissa - steps);
+    }
+
+    /// \brief highest value of bucket \a i
+    static std::uint64_t upper(std::size_t i)
+    {
+        if (i < linear) {
+            return i;
+        }
+        const std::size_t rest = i - linear;
+        const unsigned int bit = static_cast<unsigned int>(rest / steps) + 5;
+        const std::uint64_t mantissa = steps + rest % steps;
+        const unsigned int shift = bit - 4;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    std::atomic<std::uint64_t> counts_[buckets];
+    std::atomic<std::uint64_t> count_{0};
+    std::atomic<std::uint64_t> sum_{0};
+    std::atomic<std::uint64_t> max_{0};
+};
+
+/**
+ * \brief Records the time from its construction to its destruction.
+ * \class span
+ *
+ * \code
+ * {
+ *     pipeline::span timing(encode_latency);
+ *     cv::imencode(...);
+ * }
+ * \endcode
+ */
+class span
+{
+public:
+    explicit span(histogram & target)
+    : target_(target), start_(clock::now())
+    {}
+
+    ~span()
+    {
+        target_.record(clock::now() - start_);
+    }
+
+    span(const span &) = delete;
+    span & operator=(const span &) = delete;
+
+private:
+    histogram & target_;
+    const clock::time_point start_;
+};
+
+/**
+ * \brief The histograms of all the stages, by name.
+ * \class latency_registry
+ *
+ * Stages look up their histograms once, when they are created, and keep
+ * the reference: only \a get takes a lock. The histograms are never
+ * removed, so the references stay valid for the whole run.
+ */
+class latency_registry
+{
+public:
+    /// \brief the histogram called \a name, created the first time
+    histogram & get(const std::string & name)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        for (auto & each : histograms_) {
+            if (each.first == name) {
+                return *each.second;
+            }
+        }
+        histograms_.emplace_back(name, std::unique_ptr<histogram>(new histogram()));
+        return *histograms_.back().second;
+    }
+
+    /// \brief one line per stage with the count, the mean, p50, p99, p999 and the max in ms
+    void print_text(std::ostream & out) const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        // the names are as wide as the longest one, e.g. capture_to_reply
+        std::size_t width = 14;
+        for (const auto & each : histograms_) {
+            width = std::max(width, each.first.size() + 1);
+        }
+        out << pad("stage", width) << pad("count", 10, true)
+            << "     mean      p50      p99     p999      max (ms)" << std::endl;
+        for (const auto & each : histograms_) {
+            const histogram & h = *each.second;
+            out << pad(each.first, width) << pad(std::to_string(h.count()), 10, true)
+                << ms(h.mean()) << ms(h.percentile(0.5)) << ms(h.percentile(0.99))
+                << ms(h.percentile(0.999)) << ms(h.max()) << std::endl;
+        }
+    }
+
+    /// \brief one JSON object with a member per stage, values in microseconds
+    void print_json(std::ostream & out) const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        out << "{";
+        for (std::size_t i = 0; i < histograms_.size(); ++i) {
+            const histogram & h = *histograms_[i].second;
+            out << (i ? "," : "") << "\"" << histograms_[i].first << "\":{"
+                << "\"count\":" << h.count()
+                << ",\"mean_us\":" << static_cast<std::uint64_t>(h.mean())
+                << ",\"p50_us\":" << h.percentile(0.5)
+                << ",\"p99_us\":" << h.percentile(0.99)
+                << ",\"p999_us\":" << h.percentile(0.999)
+                << ",\"max_us\":" << h.max() << "}";
+        }
+        out << "}" << std::endl;
+    }
+
+private:
+    static std::string pad(const std::string & text, std::size_t width, bool right = false)
+    {
+        if (text.size() >= width) {
+            return text;
+        }
+        const std::string fill(width - text.size(), ' ');
+        return right ? fill + text : text + fill;
+    }
+
+    static std::string ms(double us)
+    {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%9.2f", us / 1000.0);
+        return text;
+    }
+
+    mutable boost::mutex mutex_;
+    std::vector<std::pair<std::string, std::unique_ptr<histogram>>> histograms_;
+};
+
+/// \brief the histograms of the stages of this process
+inline latency_registry & latency()
+{
+    static latency_registry registry;
+    return registry;
+}
+
+/**
+ * \brief Prints the histograms of the stages every \a period, on its own thread.
+ * \class latency_reporter
+ */
+class latency_reporter
+{
+public:
+    enum format_type { text, json };
+
+    latency_reporter(std::ostream & out, clock::duration period, format_type format = text)
+    : out_(out), period_(period), format_(format), thread_([this]{ run(); })
+    {}
+
+    /// \brief stop and print the histograms one last time
+    ~latency_reporter()
+    {
+        thread_.interrupt();
+        thread_.join();
+        print();
+    }
+
+private:
+    void run()
+    {
+        try {
+            for (;;) {
+                boost::this_thread::sleep_for(period_);
+                print();
+            }
+        }
+        catch (const boost::thread_interrupted &) {
+        }
+    }
+
+    void print()
+    {
+        if (format_ == json) {
+            latency().print_json(out_);
+        }
+        else {
+            latency().print_text(out_);
+        }
+    }
+
+    std::ostream & out_;
+    const clock::duration period_;
+    const format_type format_;
+    boost::thread thread_;
+};
+
+}
+#endif
@@ -0,0 +1,260 @@
+#ifndef PIPELINE_NAO_CAMERA_HPP
+#define PIPELINE_NAO_CAMERA_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/clock.hpp>
+#include <pipeline/frame_source.hpp>
+#include <pipeline/yuv422.hpp>
+
+#include <alerror/alerror.h>
+#include <alproxies/alvideodeviceproxy.h>
+#include <alvision/alimage.h>
+#include <alvision/alvisiondefinitions.h>
+
+#include <opencv2/opencv.hpp>
+
+#include <boost/chrono.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
+
+namespace pipeline {
+
+/**
+ * \brief Camera of NAO, subscribed once for the whole life of the object.
+ * \class nao_camera
+ *
+ * Creating the ALVideoDeviceProxy and subscribing takes much longer than
+ * getting an image, so we do it only once.
+ *
+ * In \a remote mode a thread keeps reading the images with getImageRemote
+ * at the rate of the subscription, copying each one out of its AL::ALValue,
+ * and the loop asks for the newest one with \a latest.
+ *
+ * In \a local mode there is no thread and no marshalling: \a visit takes
+ * the image with getImageLocal, wraps the buffer of the driver in a cv::Mat
+ * header and gives it back with releaseImage when \a use returns, so the
+ * image is copied only by whoever needs to keep it.
+ * getImageLocal only works when we run inside the process of NAOqi
+ * (on the robot, loaded through autoload.ini); if it fails the camera
+ * falls back to remote mode.
+ *
+ * Subscribed in AL::kYUV422ColorSpace, the native format of the camera,
+ * NAOqi doesn't convert the frames: our SSE kernels (yuv422) turn them
+ * into the grayscale the detection services need, or into BGR, straight
+ * from the buffer of the driver into images of a small frame_pool.
+ */
+class nao_camera : public streaming_source
+{
+public:
+    enum access_mode { remote, local };
+    /// what the frames of AL::kYUV422ColorSpace are converted to
+    enum yuv_output { yuv_gray, yuv_bgr };
+
+    /**
+     * \param robot_ip is the IP address of the robot
+     * \param resolution is AL::kQQVGA, AL::kQVGA, AL::kVGA...
+     * \param colour_space is AL::kBGRColorSpace, AL::kYuvColorSpace...
+     * \param fps is the rate of the subscription
+     * \param mode is remote or local (only inside NAOqi)
+     * \param yuv is what the frames are converted to with AL::kYUV422ColorSpace
+     */
+    nao_camera(const std::string & robot_ip,
+               int resolution = AL::kQVGA,
+               int colour_space = AL::kBGRColorSpace,
+               int fps = 30,
+               access_mode mode = remote,
+               yuv_output yuv = yuv_gray)
+    : proxy_(robot_ip, 9559),
+      client_(proxy_.subscribe("rapp_camera", resolution, colour_space, fps)),
+      period_(boost::chrono::duration_cast<clock::duration>(boost::chrono::duration<double>(1.0 / fps))),
+      mode_(mode), native_(colour_space == AL::kYUV422ColorSpace), yuv_(yuv), frames_(4), running_(true)
+    {
+        if (mode_ == local && !local_available()) {
+            std::cerr << "getImageLocal is not available, using getImageRemote" << std::endl;
+            mode_ = remote;
+        }
+        if (mode_ == remote) {
+            thread_ = boost::thread([this]{ run(); });
+        }
+    }
+
+    /// \brief stop reading and unsubscribe
+    ~nao_camera()
+    {
+        running_ = false;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        proxy_.unsubscribe(client_);
+    }
+
+    access_mode mode() const
+    {
+        return mode_;
+    }
+
+    /// \brief newest frame; in local mode this copies the image out of the driver buffer, unless it was converted
+    bool latest(frame & out) override
+    {
+        if (mode_ == remote) {
+            return streaming_source::latest(out);
+        }
+        return visit([&](const frame & current) {
+                        out.seq = current.seq;
+                        out.captured = current.captured;
+                        out.image = native_ ? current.image : current.image.clone();
+                        out.buffer = current.buffer;
+                     });
+    }
+
+    /// \brief in local mode \a use works on the buffer of the driver, without any copy
+    bool visit(const std::function<void(const frame &)> & use) override
+    {
+        if (mode_ == remote) {
+            return streaming_source::visit(use);
+        }
+        AL::ALImage * image = (AL::ALImage*) proxy_.getImageLocal(client_);
+        if (!image) {
+            return false;
+        }
+        frame current;
+        current.seq = local_seq_++;
+        current.captured = clock::now();
+        const cv::Mat header(image->getHeight(), image->getWidth(),
+                             CV_8UC(image->getNbLayers()), image->getData());
+        if (native_) {
+            // the conversion is the one copy of the frame
+            current.buffer = frames_.acquire();
+            if (current.buffer) {
+                current.image = *current.buffer;
+            }
+            convert(header, current.image);
+            if (current.buffer) {
+                *current.buffer = current.image;
+            }
+        }
+        else {
+            current.image = header;
+        }
+        try {
+            use(current);
+        }
+        catch (...) {
+            proxy_.releaseImage(client_);
+            throw;
+        }
+        /* MANDATORY after a getImageLocal: the buffer goes back to the driver */
+        proxy_.releaseImage(client_);
+        return true;
+    }
+
+private:
+    void run()
+    {
+        auto next = clock::now();
+        while (running_) {
+            try {
+                grab();
+            }
+            catch (const AL::ALError & e) {
+                std::cerr << "Caught exception " << e.what() << std::endl;
+            }
+            next += period_;
+            boost::this_thread::sleep_until(next);
+        }
+    }
+
+    bool local_available()
+    {
+        try {
+            if (proxy_.getImageLocal(client_)) {
+                proxy_.releaseImage(client_);
+                return true;
+            }
+        }
+        catch (const AL::ALError & e) {
+            std::cerr << "Caught exception " << e.what() << std::endl;
+        }
+        return false;
+    }
+
+    void grab()
+    {
+        /*
+         * The image is returned in the form of a container object, with the
+         * following fields:
+         * 0 = width
+         * 1 = height
+         * 2 = number of layers
+         * 6 = image buffer (size of width * height * number of layers)
+         * The buffer belongs to the ALValue, so we copy (or convert) it
+         * in an image of the pool.
+         */
+        AL::ALValue img = proxy_.getImageRemote(client_);
+        if (img.getSize() < 7) {
+            return;
+        }
+        const int width = img[0];
+        const int height = img[1];
+        const int layers = img[2];
+        cv::Mat header(height, width, CV_8UC(layers), const_cast<void*>(img[6].GetBinary()));
+        frame_pool::lease buffer = frames_.acquire();
+        cv::Mat image;
+        if (buffer) {
+            image = *buffer;
+        }
+        convert(header, image);
+        if (buffer) {
+            *buffer = image;
+        }
+        publish(image, std::move(buffer));
+        proxy_.releaseImage(client_);
+    }
+
+    /// \brief \a header of the driver in \a out: converted from YUV422, or copied as it is
+    void convert(const cv::Mat & header, cv::Mat & out) const
+    {
+        if (!native_) {
+            header.copyTo(out);
+        }
+        else if (yuv_ == yuv_bgr) {
+            yuv422::to_bgr(header, out);
+        }
+        else {
+            yuv422::to_gray(header, out);
+        }
+    }
+
+    AL::ALVideoDeviceProxy proxy_;
+    const std::string client_;
+    const clock::duration period_;
+    access_mode mode_;
+    const bool native_;
+    const yuv_output yuv_;
+    frame_pool frames_;
+    std::uint64_t local_seq_ = 0;
+    std::atomic<bool> running_;
+    boost::thread thread_;
+};
+
+}
+#endif
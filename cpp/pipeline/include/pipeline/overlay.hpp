@@ -0,0 +1,148 @@
+#ifndef PIPELINE_OVERLAY_HPP
+#define PIPELINE_OVERLAY_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/box_tracker.hpp>
+#include <pipeline/frame.hpp>
+#include <pipeline/latency.hpp>
+#include <pipeline/result_store.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace pipeline {
+
+/**
+ * \brief Keeps the most recent detections and composes them on the display.
+ * \class overlay
+ *
+ * Callbacks run on the dispatcher threads and only \a publish, into a
+ * result_store: the display thread reads the detections without locks and
+ * is the only one which draws, on its own copy of the frame.
+ * Results older than the ones already published are ignored, which
+ * can happen when several calls are in flight.
+ *
+ * With \a newest the detections are drawn on the newest frame, so the
+ * video is live and the boxes lag behind by the latency of the call.
+ * With \a matching the display keeps the last \a history frames and shows
+ * the one the detections were computed on, so the boxes fit the image
+ * and the video lags behind instead; if that frame is gone,
+ * the newest one is used.
+ * With \a tracked a box_tracker follows the boxes on every frame and
+ * re-anchors them on every result, so the video is live and the boxes too.
+ */
+class overlay
+{
+public:
+    enum match_mode
+    {
+        newest,
+        matching,
+        tracked
+    };
+
+    overlay(cv::Scalar colour,
+            int thickness,
+            match_mode mode = newest,
+            std::size_t history = 16)
+    : colour_(colour), thickness_(thickness), mode_(mode), history_(history)
+    {}
+
+    /// \brief publish the detections found in frame \a seq (any thread)
+    void publish(std::uint64_t seq, std::vector<detection> items)
+    {
+        results_.publish(seq, std::move(items));
+    }
+
+    /// \brief a copy of the newest or of the matching frame, with the detections (display thread only)
+    cv::Mat compose(const frame & latest)
+    {
+        span timing(compose_latency_);
+        const auto & found = results_.latest();
+        if (mode_ == tracked) {
+            tracker_.update(latest);
+            if (found.valid && (!anchored_ || found.seq != anchor_seq_)) {
+                tracker_.anchor(found.seq, found.value);
+                anchored_ = true;
+                anchor_seq_ = found.seq;
+            }
+            cv::Mat canvas = latest.image.clone();
+            draw(canvas, tracker_.boxes());
+            return canvas;
+        }
+        const frame * base = &latest;
+        if (mode_ == matching) {
+            recent_.push_back(latest);
+            if (recent_.size() > history_) {
+                recent_.pop_front();
+            }
+            if (found.valid) {
+                for (const auto & each : recent_) {
+                    if (each.seq == found.seq) {
+                        base = &each;
+                        break;
+                    }
+                }
+            }
+        }
+        cv::Mat canvas = base->image.clone();
+        if (found.valid) {
+            draw(canvas, found.value);
+        }
+        return canvas;
+    }
+
+    /// \brief draw the latest detections on \a canvas (display thread only)
+    void draw(cv::Mat & canvas)
+    {
+        const auto & found = results_.latest();
+        if (found.valid) {
+            draw(canvas, found.value);
+        }
+    }
+
+private:
+    void draw(cv::Mat & canvas, const std::vector<detection> & items) const
+    {
+        for (const auto & each : items) {
+            if (each.box.area() > 0) {
+                cv::rectangle(canvas, each.box.tl(), each.box.br(), colour_, thickness_, 8, 0);
+            }
+            if (!each.label.empty()) {
+                cv::Point origin = each.box.area() > 0 ? each.box.tl() : cv::Point(50, 50);
+                cv::putText(canvas, each.label, origin, cv::FONT_HERSHEY_PLAIN, 2, colour_, 2);
+            }
+        }
+    }
+
+    const cv::Scalar colour_;
+    const int thickness_;
+    const match_mode mode_;
+    const std::size_t history_;
+    result_store<std::vector<detection>> results_;
+    std::deque<frame> recent_;
+    histogram & compose_latency_ = latency().get("compose");
+    box_tracker tracker_;
+    bool anchored_ = false;
+    std::uint64_t anchor_seq_ = 0;
+};
+
+}
+#endif
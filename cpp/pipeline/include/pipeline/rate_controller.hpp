@@ -0,0 +1,143 @@
+#ifndef PIPELINE_RATE_CONTROLLER_HPP
+#define PIPELINE_RATE_CONTROLLER_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/clock.hpp>
+
+#include <boost/chrono.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+
+namespace pipeline {
+
+/**
+ * \brief Parameters of the rate_controller, all rates in calls per second.
+ */
+struct rate_settings
+{
+    /// rate used before the first reply
+    double start_rate = 2.0;
+    /// the controller never goes below this rate
+    double min_rate = 0.2;
+    /// the controller never goes above this rate
+    double max_rate = 15.0;
+    /// calls per second added every second while replies are fast
+    double increase = 0.5;
+    /// the rate is multiplied by this after an error or a slow reply
+    double decrease = 0.5;
+    /// a reply is slow when it takes longer than tolerance times the base latency
+    double tolerance = 2.0;
+};
+
+/**
+ * \brief Adapts the rate of cloud calls to what the platform can sustain.
+ * \class rate_controller
+ *
+ * Additive increase, multiplicative decrease (AIMD) on the latency and
+ * the errors of the calls: while the platform replies close to its base
+ * latency (the fastest recent reply) the rate grows slowly, and as soon
+ * as a call fails or a reply is slow the rate is cut.
+ * The rate is cut at most once for the calls which were already in flight,
+ * so several slow replies to the same burst don't collapse it.
+ *
+ * The producer asks \a ready before sending and reports \a sent,
+ * the callers report \a completed. All methods are thread safe.
+ */
+class rate_controller
+{
+public:
+    explicit rate_controller(rate_settings settings = rate_settings())
+    : settings_(settings), rate_(settings.start_rate),
+      last_sent_(clock::now() - interval()), last_decrease_(clock::now())
+    {}
+
+    /// \brief true when a new call can be sent at \a now
+    bool ready(clock::time_point now) const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        return now >= last_sent_ + interval();
+    }
+
+    /// \brief time at which the next call can be sent
+    clock::time_point next() const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        return last_sent_ + interval();
+    }
+
+    /// \brief a call has been sent at \a now
+    void sent(clock::time_point now)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        last_sent_ = now;
+    }
+
+    /// \brief a call has finished after \a latency, \a ok is false when the platform didn't reply
+    void completed(clock::duration latency, bool ok)
+    {
+        const auto now = clock::now();
+        const double seconds = boost::chrono::duration<double>(latency).count();
+
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        if (ok) {
+            /* 
+             * The base latency follows the fastest replies and
+             * slowly rises again if the route to the platform changes.
+             */
+            if (base_latency_ <= 0 || seconds < base_latency_) {
+                base_latency_ = seconds;
+            }
+            else {
+                base_latency_ += (seconds - base_latency_) / 64;
+            }
+        }
+
+        if (!ok || seconds > settings_.tolerance * base_latency_) {
+            if (now - latency >= last_decrease_) {
+                rate_ = std::max(settings_.min_rate, rate_ * settings_.decrease);
+                last_decrease_ = now;
+            }
+        }
+        else {
+            rate_ = std::min(settings_.max_rate, rate_ + settings_.increase / rate_);
+        }
+    }
+
+    /// \brief current rate in calls per second
+    double rate() const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        return rate_;
+    }
+
+private:
+    clock::duration interval() const
+    {
+        return boost::chrono::duration_cast<clock::duration>(
+                            boost::chrono::duration<double>(1.0 / rate_));
+    }
+
+    const rate_settings settings_;
+    mutable boost::mutex mutex_;
+    double rate_;
+    double base_latency_ = 0;
+    clock::time_point last_sent_;
+    clock::time_point last_decrease_;
+};
+
+}
+#endif
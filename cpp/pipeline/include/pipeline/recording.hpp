@@ -0,0 +1,59 @@
+#ifndef PIPELINE_RECORDING_HPP
+#define PIPELINE_RECORDING_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <opencv2/opencv.hpp>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace pipeline {
+
+/**
+ * \brief Read recorded frames: every image of the folder \a path or,
+ * if it isn't a folder of images, every frame of the video \a path.
+ * At most \a max_frames are read.
+ */
+inline std::vector<cv::Mat> load_frames(const std::string & path, std::size_t max_frames)
+{
+    std::vector<cv::Mat> frames;
+    std::vector<std::string> files;
+    try {
+        cv::glob(path + "/*", files);
+    }
+    catch (const cv::Exception &) {
+        // OpenCV 2.4 throws when path is not a folder: it is read as a video below
+        files.clear();
+    }
+    for (const auto & file : files) {
+        cv::Mat image = cv::imread(file, CV_LOAD_IMAGE_COLOR);
+        if (!image.empty() && frames.size() < max_frames) {
+            frames.push_back(image);
+        }
+    }
+    if (frames.empty()) {
+        cv::VideoCapture video(path);
+        cv::Mat image;
+        while (frames.size() < max_frames && video.read(image) && !image.empty()) {
+            frames.push_back(image.clone());
+        }
+    }
+    return frames;
+}
+
+}
+#endif
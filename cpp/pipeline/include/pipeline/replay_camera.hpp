@@ -0,0 +1,80 @@
+#ifndef PIPELINE_REPLAY_CAMERA_HPP
+#define PIPELINE_REPLAY_CAMERA_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/clock.hpp>
+#include <pipeline/frame_source.hpp>
+#include <pipeline/recording.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <boost/chrono.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace pipeline {
+
+/**
+ * \brief Stand-in for a camera which replays recorded frames.
+ * \class replay_camera
+ *
+ * All the frames are loaded in memory first, so the replay is not
+ * slowed down by the disk, and then published at \a fps in a loop.
+ * It lets us run and measure the loops of the robot on any computer.
+ */
+class replay_camera : public streaming_source
+{
+public:
+    replay_camera(const std::string & path, double fps = 30, std::size_t max_frames = 1000)
+    : frames_(load_frames(path, max_frames)),
+      period_(boost::chrono::duration_cast<clock::duration>(boost::chrono::duration<double>(1.0 / fps))),
+      running_(true), thread_([this]{ run(); })
+    {}
+
+    ~replay_camera()
+    {
+        running_ = false;
+        thread_.join();
+    }
+
+    /// \brief number of recorded frames, 0 if nothing could be read
+    std::size_t size() const
+    {
+        return frames_.size();
+    }
+
+private:
+    void run()
+    {
+        auto next = clock::now();
+        for (std::size_t i = 0; running_ && !frames_.empty(); i = (i + 1) % frames_.size()) {
+            publish(frames_[i]);
+            next += period_;
+            boost::this_thread::sleep_until(next);
+        }
+    }
+
+    const std::vector<cv::Mat> frames_;
+    const clock::duration period_;
+    std::atomic<bool> running_;
+    boost::thread thread_;
+};
+
+}
+#endif
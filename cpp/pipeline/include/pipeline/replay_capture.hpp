@@ -0,0 +1,105 @@
+#ifndef PIPELINE_REPLAY_CAPTURE_HPP
+#define PIPELINE_REPLAY_CAPTURE_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/clock.hpp>
+#include <pipeline/recording.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <boost/chrono.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace pipeline {
+
+/**
+ * \brief A cv::VideoCapture which plays recorded frames.
+ * \class replay_capture
+ *
+ * The frames are loaded in memory first and \a read gives them at \a fps,
+ * like a camera, \a loops times; after that it returns false and
+ * \a finished is true. With \a fps 0 the frames are given as fast as they
+ * are read. It goes through the same capture_stage as a real camera,
+ * so the whole pipeline can be measured without a camera.
+ */
+class replay_capture : public cv::VideoCapture
+{
+public:
+    replay_capture(const std::string & path, double fps = 30, std::size_t loops = 1, std::size_t max_frames = 1000)
+    : frames_(load_frames(path, max_frames)),
+      period_(fps > 0 ? boost::chrono::duration_cast<clock::duration>(boost::chrono::duration<double>(1.0 / fps))
+                      : clock::duration::zero()),
+      total_(frames_.size() * loops), delivered_(0)
+    {}
+
+    bool isOpened() const override
+    {
+        return !frames_.empty();
+    }
+
+    /// \brief copy the next frame in \a image, waiting for its time; false at the end
+    bool read(cv::Mat & image) override
+    {
+        const std::size_t i = delivered_;
+        if (i >= total_) {
+            return false;
+        }
+        if (i == 0) {
+            next_ = clock::now();
+        }
+        boost::this_thread::sleep_until(next_);
+        next_ += period_;
+        /*
+         * A camera writes every frame in a new buffer,
+         * so the replay copies it as well.
+         */
+        frames_[i % frames_.size()].copyTo(image);
+        delivered_ = i + 1;
+        return true;
+    }
+
+    /// \brief number of recorded frames, 0 if nothing could be read
+    std::size_t size() const
+    {
+        return frames_.size();
+    }
+
+    /// \brief frames given so far
+    std::size_t delivered() const
+    {
+        return delivered_;
+    }
+
+    /// \brief true when every loop has been played
+    bool finished() const
+    {
+        return delivered_ >= total_;
+    }
+
+private:
+    const std::vector<cv::Mat> frames_;
+    const clock::duration period_;
+    const std::size_t total_;
+    clock::time_point next_;
+    std::atomic<std::size_t> delivered_;
+};
+
+}
+#endif
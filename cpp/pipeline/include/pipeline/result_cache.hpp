@@ -0,0 +1,298 @@
+#ifndef PIPELINE_RESULT_CACHE_HPP
+#define PIPELINE_RESULT_CACHE_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/allocation_site.hpp>
+#include <pipeline/bounded_queue.hpp>
+#include <pipeline/clock.hpp>
+#include <pipeline/frame.hpp>
+#include <pipeline/latency.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <atomic>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+namespace pipeline {
+
+/**
+ * \brief Perceptual hash (dHash) of an image: 64 bits which barely change
+ * with noise, light or compression, but do change with the scene.
+ * Every bit says if a pixel of a 9x8 grayscale thumbnail is brighter than
+ * the next one in its row. The thumbnails are on the stack, so nothing
+ * is allocated for images of up to four bytes per pixel.
+ */
+inline std::uint64_t perceptual_hash(const cv::Mat & image)
+{
+    uchar small_data[9 * 8 * 4];
+    uchar gray_data[9 * 8];
+    cv::Mat small, gray(8, 9, CV_8UC1, gray_data);
+    if (image.elemSize() <= 4) {
+        small = cv::Mat(8, 9, image.type(), small_data);
+    }
+    cv::resize(image, small, cv::Size(9, 8), 0, 0, cv::INTER_AREA);
+    if (small.channels() == 3) {
+        cv::cvtColor(small, gray, CV_BGR2GRAY);
+    }
+    else {
+        gray = small;
+    }
+    std::uint64_t hash = 0;
+    for (int y = 0; y < 8; ++y) {
+        const uchar * row = gray.ptr<uchar>(y);
+        for (int x = 0; x < 8; ++x) {
+            hash = (hash << 1) | (row[x] > row[x + 1] ? 1 : 0);
+        }
+    }
+    return hash;
+}
+
+/// \brief number of different bits of two hashes
+inline int hash_distance(std::uint64_t a, std::uint64_t b)
+{
+    return static_cast<int>(std::bitset<64>(a ^ b).count());
+}
+
+/// \brief size, tolerance and lifetime of the cached results
+struct cache_settings
+{
+    /// scenes remembered, the least recently used is forgotten
+    std::size_t capacity = 64;
+    /// two frames with hashes this close are the same scene
+    int max_distance = 6;
+    /// a result older than this is not used
+    clock::duration ttl = boost::chrono::seconds(60);
+};
+
+/**
+ * \brief The results of the scenes seen lately, found by perceptual hash.
+ * \class result_cache
+ *
+ * Robots see the same places again and again. When a frame is close
+ * enough to a scene whose result is known, and the result is recent,
+ * there is no need to ask the platform again.
+ * \a lookup is called before the upload and remembers the hash of the
+ * frames it doesn't know; \a store is called with the detections of
+ * the frame once the platform replies, and \a forget when the frame is
+ * settled without asking it. The hashes of the frames asked are kept
+ * in a ring which never allocates. Thread-safe.
+ */
+class result_cache
+{
+public:
+    explicit result_cache(cache_settings settings = cache_settings())
+    : settings_(settings)
+    {}
+
+    /// \brief the result of the scene of \a current, false if it must be asked to the platform
+    bool lookup(const frame & current, std::vector<detection> & found)
+    {
+        std::uint64_t hash;
+        {
+            allocation_scope hashing(allocation_site::opencv);
+            hash = perceptual_hash(current.image);
+        }
+        const auto now = clock::now();
+
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        auto it = closest(hash);
+        if (it != entries_.end() && now - it->stored <= settings_.ttl) {
+            entries_.splice(entries_.begin(), entries_, it);
+            found = it->value;
+            ++hits_;
+            return true;
+        }
+        pending_[next_] = pending_hash{current.seq, hash, true};
+        next_ = (next_ + 1) % max_pending;
+        ++misses_;
+        return false;
+    }
+
+    /// \brief remember the detections of frame \a seq
+    void store(std::uint64_t seq, const std::vector<detection> & found)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        pending_hash * waiting = find_pending(seq);
+        if (!waiting) {
+            return;
+        }
+        const std::uint64_t hash = waiting->hash;
+        waiting->waiting = false;
+
+        auto it = closest(hash);
+        if (it != entries_.end()) {
+            entries_.erase(it);
+        }
+        entries_.push_front(entry{hash, clock::now(), found});
+        while (entries_.size() > settings_.capacity) {
+            entries_.pop_back();
+        }
+    }
+
+    /// \brief stop waiting for the detections of frame \a seq, which the platform won't give
+    void forget(std::uint64_t seq)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        if (pending_hash * waiting = find_pending(seq)) {
+            waiting->waiting = false;
+        }
+    }
+
+    std::uint64_t hits() const
+    {
+        return hits_;
+    }
+
+    std::uint64_t misses() const
+    {
+        return misses_;
+    }
+
+    /// \brief print the hits, the misses and the hit ratio in one line
+    void print(std::ostream & out) const
+    {
+        const std::uint64_t found = hits_, asked = misses_;
+        out << found << " cache hits, " << asked << " misses ("
+            << (found + asked > 0 ? 100.0 * found / (found + asked) : 0.0)
+            << "% hits)" << std::endl;
+    }
+
+private:
+    struct entry
+    {
+        std::uint64_t hash;
+        clock::time_point stored;
+        std::vector<detection> value;
+    };
+
+    /// \brief the hash of a frame asked to the platform
+    struct pending_hash
+    {
+        std::uint64_t seq;
+        std::uint64_t hash;
+        bool waiting;
+    };
+
+    /// \brief the hash of frame \a seq if it's still waiting, null otherwise
+    pending_hash * find_pending(std::uint64_t seq)
+    {
+        for (auto & each : pending_) {
+            if (each.waiting && each.seq == seq) {
+                return &each;
+            }
+        }
+        return nullptr;
+    }
+
+    /// \brief the entry closest to \a hash within the distance allowed
+    std::list<entry>::iterator closest(std::uint64_t hash)
+    {
+        auto best = entries_.end();
+        int best_distance = settings_.max_distance + 1;
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            const int distance = hash_distance(hash, it->hash);
+            if (distance < best_distance) {
+                best = it;
+                best_distance = distance;
+            }
+        }
+        return best;
+    }
+
+    /// frames asked to the platform whose hash is kept
+    static const std::size_t max_pending = 32;
+
+    const cache_settings settings_;
+    boost::mutex mutex_;
+    std::list<entry> entries_;
+    pending_hash pending_[max_pending] = {};
+    std::size_t next_ = 0;
+    std::atomic<std::uint64_t> hits_{0};
+    std::atomic<std::uint64_t> misses_{0};
+};
+
+/**
+ * \brief Answers from a result_cache the frames it knows and sends on the others.
+ * \class cache_stage
+ *
+ * On a hit \a on_hit gets the number of the frame and the cached
+ * detections at once, on this thread, as if the platform had replied;
+ * the frame doesn't go any further. The thread is on the frame path
+ * (allocation_site), except in \a on_hit, which belongs to the program.
+ */
+class cache_stage
+{
+public:
+    typedef std::function<void(std::uint64_t, const std::vector<detection> &)> hit_function;
+
+    cache_stage(bounded_queue<frame> & input,
+                bounded_queue<frame> & output,
+                result_cache & cache,
+                hit_function on_hit)
+    : input_(input), output_(output), cache_(cache), on_hit_(on_hit),
+      thread_([this]{ run(); })
+    {}
+
+    /// \brief close the input queue and join the thread
+    ~cache_stage()
+    {
+        input_.close();
+        thread_.join();
+    }
+
+private:
+    void run()
+    {
+        allocation_scope site(allocation_site::frame_path);
+        frame current;
+        std::vector<detection> found;
+        while (input_.pop(current)) {
+            bool hit;
+            {
+                span timing(lookup_latency_);
+                hit = cache_.lookup(current, found);
+            }
+            if (hit) {
+                allocation_scope program(allocation_site::elsewhere);
+                on_hit_(current.seq, found);
+                continue;
+            }
+            if (!output_.push(std::move(current))) {
+                break;
+            }
+        }
+    }
+
+    bounded_queue<frame> & input_;
+    bounded_queue<frame> & output_;
+    result_cache & cache_;
+    hit_function on_hit_;
+    histogram & lookup_latency_ = latency().get("cache");
+    boost::thread thread_;
+};
+
+}
+#endif
@@ -0,0 +1,113 @@
+#ifndef PIPELINE_RESULT_SINK_HPP
+#define PIPELINE_RESULT_SINK_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/clock.hpp>
+#include <pipeline/frame.hpp>
+
+#include <boost/chrono.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace pipeline {
+
+/**
+ * \brief Writes the results as JSON lines.
+ * \class result_sink
+ *
+ * One line per frame, e.g.
+ * `{"ms":1520,"service":"face_detection","seq":42,"cached":false,"results":[{"x":10,"y":20,"width":50,"height":50,"label":""}]}`
+ * where \a ms is the time since the sink was created. The line is built
+ * first and written at once under a mutex, so the callbacks of several
+ * threads never mix their lines. Without a file it writes to std::cout.
+ */
+class result_sink
+{
+public:
+    /// \brief write to \a out (std::cout by default)
+    result_sink(std::ostream & out = std::cout)
+    : out_(&out), start_(clock::now())
+    {}
+
+    /// \brief write to the file \a path, or to std::cout if \a path is empty
+    result_sink(const std::string & path)
+    : out_(&std::cout), start_(clock::now())
+    {
+        if (!path.empty()) {
+            file_.open(path.c_str(), std::ios::out | std::ios::app);
+            if (file_) {
+                out_ = &file_;
+            }
+            else {
+                std::cerr << "Can't open " << path << ", the results go to the console" << std::endl;
+            }
+        }
+    }
+
+    /// \brief write the \a found results of the frame \a seq
+    void write(const std::string & service,
+               std::uint64_t seq,
+               const std::vector<detection> & found,
+               bool cached = false)
+    {
+        std::ostringstream line;
+        line << "{\"ms\":" << boost::chrono::duration_cast<boost::chrono::milliseconds>(clock::now() - start_).count()
+             << ",\"service\":\"" << service << "\""
+             << ",\"seq\":" << seq
+             << ",\"cached\":" << (cached ? "true" : "false")
+             << ",\"results\":[";
+        for (std::size_t i = 0; i < found.size(); ++i) {
+            const cv::Rect & box = found[i].box;
+            line << (i ? "," : "")
+                 << "{\"x\":" << box.x << ",\"y\":" << box.y
+                 << ",\"width\":" << box.width << ",\"height\":" << box.height
+                 << ",\"label\":\"" << escape(found[i].label) << "\"}";
+        }
+        line << "]}\n";
+
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        *out_ << line.str() << std::flush;
+    }
+
+private:
+    static std::string escape(const std::string & text)
+    {
+        std::string result;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+            }
+            if (static_cast<unsigned char>(c) >= 0x20) {
+                result += c;
+            }
+        }
+        return result;
+    }
+
+    std::ofstream file_;
+    std::ostream * out_;
+    const clock::time_point start_;
+    boost::mutex mutex_;
+};
+
+}
+#endif
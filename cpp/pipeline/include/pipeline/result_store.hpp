@@ -0,0 +1,101 @@
+#ifndef PIPELINE_RESULT_STORE_HPP
+#define PIPELINE_RESULT_STORE_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <boost/thread/mutex.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+namespace pipeline {
+
+/**
+ * \brief The newest result of the cloud, handed to one reader without locks.
+ * \class result_store
+ *
+ * A triple buffer: the writers fill a slot of their own and swap it with
+ * the middle one, the reader swaps the middle one with its slot when it
+ * holds a newer result. The reader never waits and never copies \a T,
+ * and the slot it holds is not touched until it asks for the next one.
+ *
+ * Every result carries the sequence number of the frame it was computed on.
+ * The callbacks of several calls in flight may publish at the same time,
+ * so the writers are serialized among themselves, and a result older than
+ * the one already published is ignored.
+ * Only one thread may call \a latest.
+ */
+template <class T>
+class result_store
+{
+public:
+    /// \brief a result and the frame it belongs to
+    struct result
+    {
+        std::uint64_t seq = 0;
+        bool valid = false;
+        T value;
+    };
+
+    result_store() = default;
+    result_store(const result_store &) = delete;
+    result_store & operator=(const result_store &) = delete;
+
+    /// \brief publish the result of frame \a seq (any thread)
+    void publish(std::uint64_t seq, T value)
+    {
+        boost::unique_lock<boost::mutex> lock(writers_);
+        if (published_ && seq < last_seq_) {
+            return;
+        }
+        result & slot = slots_[back_];
+        slot.seq = seq;
+        slot.valid = true;
+        slot.value = std::move(value);
+        published_ = true;
+        last_seq_ = seq;
+        back_ = middle_.exchange(back_ | fresh, std::memory_order_acq_rel) & index;
+    }
+
+    /**
+     * \brief the newest result published (reader thread only).
+     * The reference stays valid and unchanged until the next call;
+     * `valid` is false until the first result is published.
+     */
+    const result & latest()
+    {
+        if (middle_.load(std::memory_order_relaxed) & fresh) {
+            front_ = middle_.exchange(front_, std::memory_order_acq_rel) & index;
+        }
+        return slots_[front_];
+    }
+
+private:
+    static const unsigned int index = 3;
+    static const unsigned int fresh = 4;
+
+    result slots_[3];
+    std::atomic<unsigned int> middle_{1};
+    unsigned int back_ = 0;
+    unsigned int front_ = 2;
+
+    boost::mutex writers_;
+    bool published_ = false;
+    std::uint64_t last_seq_ = 0;
+};
+
+}
+#endif
@@ -0,0 +1,322 @@
+#ifndef PIPELINE_ROI_STAGE_HPP
+#define PIPELINE_ROI_STAGE_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/allocation_site.hpp>
+#include <pipeline/bounded_queue.hpp>
+#include <pipeline/frame.hpp>
+#include <pipeline/latency.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pipeline {
+
+/**
+ * \brief A cheap local detector which finds where the cloud should look.
+ * \class roi_detector
+ *
+ * It receives a small grayscale copy of the frame and fills the
+ * candidate regions in its coordinates. It runs on the thread
+ * of the roi_stage only.
+ */
+class roi_detector
+{
+public:
+    virtual ~roi_detector() = default;
+
+    /// \brief replace \a regions with the regions of \a gray worth sending to the platform
+    virtual void find(const cv::Mat & gray, std::vector<cv::Rect> & regions) = 0;
+};
+
+/**
+ * \brief Regions where the image has changed since the previous frame.
+ * \class motion_roi
+ *
+ * Good enough for people walking in front of a fixed camera.
+ */
+class motion_roi : public roi_detector
+{
+public:
+    /// \a threshold is the change of a pixel, \a min_area the smallest blob in pixels of the small frame
+    motion_roi(int threshold = 25, int min_area = 64)
+    : threshold_(threshold), min_area_(min_area),
+      kernel_(cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5)))
+    {}
+
+    void find(const cv::Mat & gray, std::vector<cv::Rect> & regions) override
+    {
+        regions.clear();
+        if (previous_.size() == gray.size()) {
+            cv::absdiff(gray, previous_, moved_);
+            cv::threshold(moved_, moved_, threshold_, 255, cv::THRESH_BINARY);
+            cv::dilate(moved_, moved_, kernel_);
+
+            cv::findContours(moved_, blobs_, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+            for (const auto & each : blobs_) {
+                const cv::Rect box = cv::boundingRect(each);
+                if (box.area() >= min_area_) {
+                    regions.push_back(box);
+                }
+            }
+        }
+        gray.copyTo(previous_);
+    }
+
+private:
+    const int threshold_;
+    const int min_area_;
+    const cv::Mat kernel_;
+    cv::Mat previous_;
+    cv::Mat moved_;
+    std::vector<std::vector<cv::Point>> blobs_;
+};
+
+/**
+ * \brief Regions found by an OpenCV cascade (Haar or LBP).
+ * \class cascade_roi
+ *
+ * An LBP face cascade on a half resolution frame takes a few milliseconds,
+ * much less than encoding and uploading the whole frame.
+ * If the file can't be loaded, \a loaded is false and nothing is found.
+ */
+class cascade_roi : public roi_detector
+{
+public:
+    explicit cascade_roi(const std::string & path, cv::Size min_size = cv::Size(20, 20))
+    : min_size_(min_size)
+    {
+        cascade_.load(path);
+    }
+
+    bool loaded() const
+    {
+        return !cascade_.empty();
+    }
+
+    void find(const cv::Mat & gray, std::vector<cv::Rect> & regions) override
+    {
+        regions.clear();
+        if (loaded()) {
+            cv::equalizeHist(gray, equalized_);
+            cascade_.detectMultiScale(equalized_, regions, 1.2, 2, CV_HAAR_SCALE_IMAGE, min_size_);
+        }
+    }
+
+private:
+    const cv::Size min_size_;
+    cv::CascadeClassifier cascade_;
+    cv::Mat equalized_;
+};
+
+/// \brief how the roi_stage looks for the regions and crops them
+struct roi_settings
+{
+    /// the detector runs on the frame scaled by this
+    double scale = 0.5;
+    /// every region grows by this fraction of its size on each side
+    double margin = 0.25;
+    /// frames without candidates are not sent, but every this many one is sent whole
+    unsigned int full_every = 10;
+};
+
+/**
+ * \brief Uploads only the part of the frame where something was found.
+ * \class roi_stage
+ *
+ * Faces and humans often fill a small patch of the frame. This stage runs
+ * a roi_detector on a small grayscale copy of every frame and sends on the
+ * crop which holds all the candidate regions, with a margin around them.
+ * The crop keeps the number of its frame, and \a map_back moves the boxes
+ * found in it back to the coordinates of the whole frame.
+ * Frames without candidates are dropped, except one every \a full_every,
+ * which is sent whole so the platform still sees what the detector misses.
+ * The number of a dropped frame goes to \a on_empty: it has no detections,
+ * and the boxes of an older frame must not stay on screen.
+ * Without a detector the frames go through untouched.
+ * The origins of the crops are kept in a ring which never allocates.
+ * The thread is on the frame path (allocation_site), except while the
+ * detector runs, which is OpenCV's work, and in \a on_empty, which
+ * belongs to the program.
+ */
+class roi_stage
+{
+public:
+    typedef std::function<void(std::uint64_t)> empty_function;
+
+    roi_stage(bounded_queue<frame> & input,
+              bounded_queue<frame> & output,
+              roi_detector * detector,
+              roi_settings settings = roi_settings(),
+              empty_function on_empty = nullptr)
+    : input_(input), output_(output), detector_(detector), settings_(settings),
+      on_empty_(on_empty), thread_([this]{ run(); })
+    {}
+
+    /// \brief close the input queue and join the thread
+    ~roi_stage()
+    {
+        input_.close();
+        thread_.join();
+    }
+
+    /// \brief move the boxes found in the crop of frame \a seq to the coordinates of the frame
+    std::vector<detection> map_back(std::uint64_t seq, std::vector<detection> found) const
+    {
+        cv::Point origin(0, 0);
+        {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            for (std::size_t i = 0; i < kept_; ++i) {
+                if (origins_[i].first == seq) {
+                    origin = origins_[i].second;
+                    break;
+                }
+            }
+        }
+        for (auto & each : found) {
+            if (each.box.area() > 0) {
+                each.box.x += origin.x;
+                each.box.y += origin.y;
+            }
+        }
+        return found;
+    }
+
+    /// \brief print how many frames were cropped or dropped, and the share of pixels sent
+    void print(std::ostream & out) const
+    {
+        const double in = static_cast<double>(pixels_in_);
+        out << cropped_ << " frames cropped, " << dropped_ << " without candidates, "
+            << (in > 0 ? 100.0 * pixels_out_ / in : 100.0) << "% of the pixels sent" << std::endl;
+    }
+
+private:
+    void run()
+    {
+        allocation_scope site(allocation_site::frame_path);
+        frame current;
+        unsigned int empty = 0;
+        while (input_.pop(current)) {
+            const std::uint64_t total = current.image.total();
+            pixels_in_ += total;
+
+            if (detector_) {
+                cv::Rect area;
+                {
+                    allocation_scope detecting(allocation_site::opencv);
+                    span timing(roi_latency_);
+                    area = region(current.image);
+                }
+                if (area.area() == 0) {
+                    if (++empty < settings_.full_every) {
+                        ++dropped_;
+                        if (on_empty_) {
+                            allocation_scope program(allocation_site::elsewhere);
+                            on_empty_(current.seq);
+                        }
+                        continue;
+                    }
+                }
+                else if (area.area() < static_cast<int>(total)) {
+                    remember(current.seq, area.tl());
+                    current.image = current.image(area);
+                    ++cropped_;
+                }
+                empty = 0;
+            }
+            pixels_out_ += current.image.total();
+            if (!output_.push(std::move(current))) {
+                break;
+            }
+        }
+    }
+
+    /// \brief the crop of \a image holding every candidate, empty if there is none
+    cv::Rect region(const cv::Mat & image)
+    {
+        cv::resize(image, small_, cv::Size(), settings_.scale, settings_.scale, cv::INTER_AREA);
+        if (small_.channels() == 3) {
+            cv::cvtColor(small_, gray_, CV_BGR2GRAY);
+        }
+        else {
+            small_.copyTo(gray_);
+        }
+
+        detector_->find(gray_, regions_);
+        cv::Rect all;
+        for (const auto & each : regions_) {
+            all = all.area() > 0 ? (all | each) : each;
+        }
+        if (all.area() == 0) {
+            return cv::Rect();
+        }
+
+        const double grow = 1.0 / settings_.scale;
+        const int mx = cvRound(all.width * settings_.margin * grow);
+        const int my = cvRound(all.height * settings_.margin * grow);
+        const cv::Rect scaled(cvRound(all.x * grow) - mx,
+                              cvRound(all.y * grow) - my,
+                              cvRound(all.width * grow) + 2 * mx,
+                              cvRound(all.height * grow) + 2 * my);
+        return scaled & cv::Rect(0, 0, image.cols, image.rows);
+    }
+
+    void remember(std::uint64_t seq, cv::Point origin)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        origins_[next_] = std::make_pair(seq, origin);
+        next_ = (next_ + 1) % max_origins;
+        if (kept_ < max_origins) {
+            ++kept_;
+        }
+    }
+
+    /// calls in flight whose crop is kept
+    static const std::size_t max_origins = 32;
+
+    bounded_queue<frame> & input_;
+    bounded_queue<frame> & output_;
+    roi_detector * detector_;
+    const roi_settings settings_;
+    empty_function on_empty_;
+    cv::Mat small_;
+    cv::Mat gray_;
+    std::vector<cv::Rect> regions_;
+    mutable boost::mutex mutex_;
+    std::pair<std::uint64_t, cv::Point> origins_[max_origins];
+    std::size_t next_ = 0;
+    std::size_t kept_ = 0;
+    histogram & roi_latency_ = latency().get("roi");
+    std::atomic<std::uint64_t> pixels_in_{0};
+    std::atomic<std::uint64_t> pixels_out_{0};
+    std::atomic<std::uint64_t> cropped_{0};
+    std::atomic<std::uint64_t> dropped_{0};
+    boost::thread thread_;
+};
+
+}
+#endif
@@ -0,0 +1,204 @@
+#ifndef PIPELINE_SCALE_STAGE_HPP
+#define PIPELINE_SCALE_STAGE_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/allocation_site.hpp>
+#include <pipeline/bounded_queue.hpp>
+#include <pipeline/frame.hpp>
+#include <pipeline/latency.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+namespace pipeline {
+
+/**
+ * \brief The scale of the frames sent by a scale_stage, by frame number.
+ * \class scale_map
+ *
+ * Kept apart from the stage so that it can outlive it: the replies of
+ * the calls still in flight when the stage stops are mapped back too.
+ * Only the frames of the last calls are kept, in a ring which never
+ * allocates.
+ */
+class scale_map
+{
+public:
+    /// \brief frame \a seq was divided by \a factor
+    void remember(std::uint64_t seq, cv::Point2d factor)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        factors_[next_] = std::make_pair(seq, factor);
+        next_ = (next_ + 1) % max_factors;
+        if (kept_ < max_factors) {
+            ++kept_;
+        }
+    }
+
+    /// \brief scale the boxes found in the small copy of frame \a seq to the coordinates of the frame
+    std::vector<detection> map_back(std::uint64_t seq, std::vector<detection> found) const
+    {
+        cv::Point2d factor(1, 1);
+        {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            std::size_t i = 0;
+            while (i < kept_ && factors_[i].first != seq) {
+                ++i;
+            }
+            if (i == kept_) {
+                return found;
+            }
+            factor = factors_[i].second;
+        }
+        for (auto & each : found) {
+            if (each.box.area() > 0) {
+                const int right = cvRound((each.box.x + each.box.width) * factor.x);
+                const int bottom = cvRound((each.box.y + each.box.height) * factor.y);
+                each.box.x = cvRound(each.box.x * factor.x);
+                each.box.y = cvRound(each.box.y * factor.y);
+                each.box.width = right - each.box.x;
+                each.box.height = bottom - each.box.y;
+            }
+        }
+        return found;
+    }
+
+private:
+    /// calls in flight whose scale is kept
+    static const std::size_t max_factors = 32;
+
+    mutable boost::mutex mutex_;
+    std::pair<std::uint64_t, cv::Point2d> factors_[max_factors];
+    std::size_t next_ = 0;
+    std::size_t kept_ = 0;
+};
+
+/**
+ * \brief Scales the uploaded frames down to the size a service needs.
+ * \class scale_stage
+ *
+ * The camera keeps its resolution for the window and the local stages;
+ * only the copy which is uploaded is shrunk to fit in \a limit, keeping
+ * its aspect ratio, with area interpolation: every pixel is the mean of
+ * a block of the frame, which OpenCV vectorises and which keeps the
+ * edges the services look for. The platform takes less time and the
+ * upload is smaller.
+ * The small copy keeps the number of its frame, and the \a factors
+ * scale the boxes found in it back to the coordinates of the frame.
+ * Frames which already fit, or all of them with an empty \a limit, go
+ * through untouched. The small copies are written in a frame_pool of
+ * their own.
+ */
+class scale_stage
+{
+public:
+    scale_stage(bounded_queue<frame> & input,
+                bounded_queue<frame> & output,
+                scale_map & factors,
+                cv::Size limit,
+                std::size_t buffers = 4)
+    : input_(input), output_(output), factors_(factors), limit_(limit), buffers_(buffers),
+      thread_([this]{ run(); })
+    {}
+
+    /// \brief close the input queue and join the thread
+    ~scale_stage()
+    {
+        input_.close();
+        thread_.join();
+    }
+
+    /// \brief largest picture sent on
+    cv::Size limit() const
+    {
+        return limit_;
+    }
+
+    /// \brief print how many frames were scaled down, and the share of pixels sent
+    void print(std::ostream & out) const
+    {
+        const double in = static_cast<double>(pixels_in_);
+        out << scaled_frames_ << " frames scaled to fit " << limit_.width << "x" << limit_.height << ", "
+            << (in > 0 ? 100.0 * pixels_out_ / in : 100.0) << "% of the pixels sent" << std::endl;
+    }
+
+private:
+    void run()
+    {
+        allocation_scope site(allocation_site::frame_path);
+        frame current;
+        while (input_.pop(current)) {
+            pixels_in_ += current.image.total();
+            const double fit = limit_.area() > 0
+                             ? std::min(static_cast<double>(limit_.width) / current.image.cols,
+                                        static_cast<double>(limit_.height) / current.image.rows)
+                             : 1.0;
+            if (fit < 1.0) {
+                const cv::Size size(std::max(1, cvRound(current.image.cols * fit)),
+                                    std::max(1, cvRound(current.image.rows * fit)));
+                frame small;
+                small.seq = current.seq;
+                small.captured = current.captured;
+                small.buffer = buffers_.acquire();
+                if (small.buffer) {
+                    small.image = *small.buffer;
+                }
+                {
+                    allocation_scope resizing(allocation_site::opencv);
+                    span timing(scale_latency_);
+                    cv::resize(current.image, small.image, size, 0, 0, cv::INTER_AREA);
+                }
+                if (small.buffer) {
+                    *small.buffer = small.image;
+                }
+                factors_.remember(current.seq,
+                                  cv::Point2d(static_cast<double>(current.image.cols) / size.width,
+                                              static_cast<double>(current.image.rows) / size.height));
+                // the frame of the camera goes back to its pool before we wait for room
+                current = std::move(small);
+                ++scaled_frames_;
+            }
+            pixels_out_ += current.image.total();
+            if (!output_.push(std::move(current))) {
+                break;
+            }
+        }
+    }
+
+    bounded_queue<frame> & input_;
+    bounded_queue<frame> & output_;
+    scale_map & factors_;
+    const cv::Size limit_;
+    frame_pool buffers_;
+    histogram & scale_latency_ = latency().get("scale");
+    std::atomic<std::uint64_t> pixels_in_{0};
+    std::atomic<std::uint64_t> pixels_out_{0};
+    std::atomic<std::uint64_t> scaled_frames_{0};
+    boost::thread thread_;
+};
+
+}
+#endif
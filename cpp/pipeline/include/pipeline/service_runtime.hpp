@@ -0,0 +1,475 @@
+#ifndef PIPELINE_SERVICE_RUNTIME_HPP
+#define PIPELINE_SERVICE_RUNTIME_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/batch_stage.hpp>
+#include <pipeline/bounded_queue.hpp>
+#include <pipeline/capture_stage.hpp>
+#include <pipeline/change_detector.hpp>
+#include <pipeline/cloud_dispatcher.hpp>
+#include <pipeline/codec.hpp>
+#include <pipeline/controller_pool.hpp>
+#include <pipeline/encode_pool.hpp>
+#include <pipeline/frame.hpp>
+#include <pipeline/latency.hpp>
+#include <pipeline/rate_controller.hpp>
+#include <pipeline/result_cache.hpp>
+#include <pipeline/roi_stage.hpp>
+#include <pipeline/scale_stage.hpp>
+#include <pipeline/service_traits.hpp>
+
+#include <opencv2/opencv.hpp>
+#include <rapp/cloud/service_controller.hpp>
+#include <rapp/objects/picture.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+namespace pipeline {
+
+/// \brief how the service_runtime builds its stages
+struct runtime_settings
+{
+    /// capacity of the frame queues, the queue of the encoded frames is twice as long
+    std::size_t queue = 2;
+    /// calls in flight at the same time
+    unsigned int window = 2;
+    /// encoding threads
+    unsigned int encoders = 2;
+    /// images of the camera, enough for the queues and the stages; add the frames an overlay keeps
+    std::size_t frames = 16;
+    /// largest picture uploaded, empty for the upload size of the service (service_traits)
+    cv::Size upload;
+    /// frames older than this are dropped by the stages which take them, zero keeps them all
+    clock::duration max_age = boost::chrono::seconds(1);
+    rate_settings rate;
+    change_settings changes;
+    cache_settings cache;
+    /// local detector of the roi_front, nullptr sends the frames whole
+    roi_detector * detector = nullptr;
+    roi_settings roi;
+    batch_settings batch;
+};
+
+/**
+ * \brief No stage between the cache and the encoders.
+ * \class direct_front
+ *
+ * A front is what runs between the cache and the encoders. It is built
+ * on the queue of the frames the cache didn't know and gives the queue
+ * of the encoders in \a output. \a each gives the detections of call
+ * \a seq to \a on_frame once for every frame they belong to, in the
+ * coordinates of that frame. Fronts are nested as template parameters,
+ * so \a each is inlined in the call. A front which settles a frame
+ * without a call (e.g. no candidates) gives its detections to the
+ * \a on_found of its constructor, in the numbers of its input.
+ * \a dropped and \a stale count the frames dropped by the queues of the
+ * front.
+ */
+class direct_front
+{
+public:
+    typedef std::function<void(std::uint64_t, std::vector<detection>)> found_function;
+
+    direct_front(bounded_queue<frame> & input, const runtime_settings &, found_function)
+    : input_(input)
+    {}
+
+    bounded_queue<frame> & output()
+    {
+        return input_;
+    }
+
+    template <class Found>
+    void each(std::uint64_t seq, std::vector<detection> found, Found && on_frame) const
+    {
+        on_frame(seq, std::move(found));
+    }
+
+    std::uint64_t dropped() const
+    {
+        return 0;
+    }
+
+    std::uint64_t stale() const
+    {
+        return 0;
+    }
+
+    void print(std::ostream &) const
+    {}
+
+private:
+    bounded_queue<frame> & input_;
+};
+
+/**
+ * \brief A roi_stage, then \a Next.
+ * \class roi_front
+ *
+ * Uploads only the crop where the detector of the settings found
+ * candidates, and moves the boxes back to the whole frame. A frame
+ * without candidates is settled with no detections.
+ */
+template <class Next = direct_front>
+class roi_front
+{
+public:
+    typedef direct_front::found_function found_function;
+
+    roi_front(bounded_queue<frame> & input, const runtime_settings & settings, found_function on_found)
+    : on_found_(on_found),
+      cropped_(settings.queue),
+      regions_(input, cropped_, settings.detector, settings.roi,
+               [this](std::uint64_t seq) { on_found_(seq, std::vector<detection>()); }),
+      next_(cropped_, settings, [this](std::uint64_t seq, std::vector<detection> boxes) {
+          on_found_(seq, regions_.map_back(seq, std::move(boxes)));
+      })
+    {
+        drop_older_than(cropped_, settings.max_age);
+    }
+
+    bounded_queue<frame> & output()
+    {
+        return next_.output();
+    }
+
+    template <class Found>
+    void each(std::uint64_t seq, std::vector<detection> found, Found && on_frame) const
+    {
+        next_.each(seq, std::move(found), [&](std::uint64_t frame_seq, std::vector<detection> boxes) {
+            on_frame(frame_seq, regions_.map_back(frame_seq, std::move(boxes)));
+        });
+    }
+
+    std::uint64_t dropped() const
+    {
+        return cropped_.dropped() + next_.dropped();
+    }
+
+    std::uint64_t stale() const
+    {
+        return cropped_.stale() + next_.stale();
+    }
+
+    void print(std::ostream & out) const
+    {
+        regions_.print(out);
+        next_.print(out);
+    }
+
+private:
+    found_function on_found_;
+    bounded_queue<frame> cropped_;
+    roi_stage regions_;
+    Next next_;
+};
+
+/**
+ * \brief A batch_stage, then \a Next.
+ * \class batch_front
+ *
+ * Tiles the frames of the batch settings in one picture, and splits
+ * the boxes found in it between the frames.
+ */
+template <class Next = direct_front>
+class batch_front
+{
+public:
+    typedef direct_front::found_function found_function;
+
+    batch_front(bounded_queue<frame> & input, const runtime_settings & settings, found_function on_found)
+    : on_found_(on_found),
+      batched_(settings.queue),
+      batcher_(input, batched_, settings.batch, 2 * settings.queue + settings.encoders + 1),
+      next_(batched_, settings, [this](std::uint64_t seq, std::vector<detection> boxes) {
+          for (auto & tile : batcher_.split(seq, boxes)) {
+              on_found_(tile.first, std::move(tile.second));
+          }
+      })
+    {
+        drop_older_than(batched_, settings.max_age);
+    }
+
+    bounded_queue<frame> & output()
+    {
+        return next_.output();
+    }
+
+    template <class Found>
+    void each(std::uint64_t seq, std::vector<detection> found, Found && on_frame) const
+    {
+        next_.each(seq, std::move(found), [&](std::uint64_t batch_seq, std::vector<detection> boxes) {
+            for (auto & tile : batcher_.split(batch_seq, boxes)) {
+                on_frame(tile.first, std::move(tile.second));
+            }
+        });
+    }
+
+    std::uint64_t dropped() const
+    {
+        return batched_.dropped() + next_.dropped();
+    }
+
+    std::uint64_t stale() const
+    {
+        return batched_.stale() + next_.stale();
+    }
+
+    void print(std::ostream & out) const
+    {
+        next_.print(out);
+    }
+
+private:
+    found_function on_found_;
+    bounded_queue<frame> batched_;
+    batch_stage batcher_;
+    Next next_;
+};
+
+/**
+ * \brief The pipeline of a vision service, from the camera to the results.
+ * \class service_runtime
+ *
+ * The stages of the tutorials, in the same order:
+ *
+ *     camera -> upload -> cache -> uncached -> Front -> scale -> encoders -> outgoing -> dispatcher
+ *            -> display
+ *
+ * \a Service chooses the call and the default codec (service_traits,
+ * default_codec) and \a Front the stages before the encoders, e.g.
+ * `roi_front<batch_front<>>`. Both are known at compile time, so the
+ * call, the conversion of the reply and the mapping of the boxes back
+ * to the frames are one inlined function.
+ * \a on_result gets the number of the frame, its detections and true if
+ * they came from the cache; it runs on a thread of the dispatcher or of
+ * the cache, so it must not draw in a window: publish in an overlay.
+ * The frames of \a display are for the window, which the program owns.
+ * The camera reads into a frame_pool of \a frames images, so in the
+ * steady state the frames are not allocated. The camera keeps its
+ * resolution: only the pictures uploaded are scaled down to the upload
+ * size of the settings or of the service, and the boxes scaled back.
+ * The frames don't queue up behind a slow stage: the camera leaves
+ * only its latest frame in \a upload, a mailbox of one, and the frames
+ * older than the \a max_age of the settings are dropped by the stage
+ * which takes them, so a late reply is never about the past.
+ * \a captured, \a dropped and \a processed count the frames, and the
+ * latency() records their age when their call starts and when it
+ * replies ("capture_to_call", "capture_to_reply").
+ * The stages start from the last one to the first one and stop in the
+ * reverse order.
+ */
+template <class Service, class Front = direct_front>
+class service_runtime
+{
+public:
+    typedef std::function<void(std::uint64_t, std::vector<detection>, bool)> result_function;
+
+    service_runtime(cv::VideoCapture & camera,
+                    const rapp::cloud::platform & info,
+                    result_function on_result,
+                    runtime_settings settings = runtime_settings(),
+                    codec format = default_codec<Service>::get())
+    : settings_(settings), on_result_(on_result), frames_(settings.frames),
+      upload_(1), uncached_(settings.queue),
+      display_(settings.queue), scaled_(settings.queue), outgoing_(2 * settings.queue),
+      cache_(settings.cache), rate_(settings.rate), changes_(settings.changes),
+      calls_(0), completed_(0), replies_(0), processed_(0),
+      front_(uncached_, settings_, [this](std::uint64_t seq, std::vector<detection> found) {
+          settle(seq, std::move(found));
+      }),
+      dispatcher_(info, outgoing_, settings.window, rate_,
+                  [this](rapp::cloud::service_controller & ctrl,
+                         const rapp::object::picture & pic,
+                         std::uint64_t seq) {
+                      return call(ctrl, pic, seq);
+                  }),
+      encoders_(scaled_, outgoing_, settings.encoders, format),
+      scaler_(front_.output(), scaled_, scales_,
+              settings.upload.area() > 0 ? settings.upload : service_traits<Service>::upload_size(),
+              settings.queue + settings.encoders + 1),
+      cached_(upload_, uncached_, cache_,
+              [this](std::uint64_t seq, const std::vector<detection> & found) {
+                  ++processed_;
+                  on_result_(seq, found, true);
+              }),
+      capture_(camera, upload_, display_, rate_, &changes_, &frames_)
+    {
+        drop_older_than(uncached_, settings.max_age);
+        drop_older_than(scaled_, settings.max_age);
+        drop_older_than(outgoing_, settings.max_age);
+    }
+
+    /// \brief every frame of the camera, for the window
+    bounded_queue<frame> & display()
+    {
+        return display_;
+    }
+
+    /// \brief calls started so far
+    std::uint64_t calls() const
+    {
+        return calls_;
+    }
+
+    /// \brief calls finished so far, replied or not
+    std::uint64_t completed() const
+    {
+        return completed_;
+    }
+
+    /// \brief calls the platform replied to
+    std::uint64_t replies() const
+    {
+        return replies_;
+    }
+
+    /// \brief frames read from the camera
+    std::uint64_t captured() const
+    {
+        return capture_.captured();
+    }
+
+    /// \brief frames replaced in the upload mailbox or dropped by the later queues, stale ones included
+    std::uint64_t dropped() const
+    {
+        return upload_.dropped() + uncached_.dropped() + scaled_.dropped() + outgoing_.dropped()
+               + front_.dropped();
+    }
+
+    /// \brief frames dropped because they were older than the max_age of the settings
+    std::uint64_t stale() const
+    {
+        return uncached_.stale() + scaled_.stale() + outgoing_.stale() + front_.stale();
+    }
+
+    /// \brief frames which got their detections, from the platform or from the cache
+    std::uint64_t processed() const
+    {
+        return processed_;
+    }
+
+    /// \brief the images the camera reads into
+    const frame_pool & frames() const
+    {
+        return frames_;
+    }
+
+    const change_detector & changes() const
+    {
+        return changes_;
+    }
+
+    const result_cache & cache() const
+    {
+        return cache_;
+    }
+
+    const controller_pool & controllers() const
+    {
+        return dispatcher_.controllers();
+    }
+
+    /// \brief print the frames and their age, the frame pool, the controllers, the cache, the front stages and the scaling
+    void print(std::ostream & out) const
+    {
+        const histogram & at_call = latency().get("capture_to_call");
+        const histogram & at_reply = latency().get("capture_to_reply");
+        out << "Frames: " << captured() << " captured, " << changes_.skipped() << " unchanged, "
+            << dropped() << " dropped (" << stale() << " older than "
+            << boost::chrono::duration_cast<boost::chrono::milliseconds>(settings_.max_age).count() << " ms), "
+            << processed() << " processed" << std::endl
+            << "Age: p50 " << at_call.percentile(0.5) / 1000.0 << " ms at the call, "
+            << at_reply.percentile(0.5) / 1000.0 << " ms at the reply, p99 "
+            << at_reply.percentile(0.99) / 1000.0 << " ms at the reply" << std::endl;
+        frames_.print(out);
+        dispatcher_.controllers().print(out);
+        cache_.print(out);
+        front_.print(out);
+        scaler_.print(out);
+    }
+
+private:
+    bool call(rapp::cloud::service_controller & ctrl,
+              const rapp::object::picture & pic,
+              std::uint64_t seq)
+    {
+        ++calls_;
+        const bool replied = service_traits<Service>::call(ctrl, pic, [&](std::vector<detection> found) {
+            front_.each(seq, scales_.map_back(seq, std::move(found)),
+                        [&](std::uint64_t frame_seq, std::vector<detection> boxes) {
+                publish(frame_seq, std::move(boxes));
+            });
+        });
+        if (replied) {
+            ++replies_;
+        }
+        ++completed_;
+        return replied;
+    }
+
+    /// \brief the detections the platform found in frame \a seq, which the cache keeps
+    void publish(std::uint64_t seq, std::vector<detection> found)
+    {
+        cache_.store(seq, found);
+        ++processed_;
+        on_result_(seq, std::move(found), false);
+    }
+
+    /**
+     * \brief the detections of frame \a seq, settled by the front without a call.
+     * The platform didn't see the frame, so the cache doesn't keep them:
+     * a similar scene must still be sent.
+     */
+    void settle(std::uint64_t seq, std::vector<detection> found)
+    {
+        cache_.forget(seq);
+        ++processed_;
+        on_result_(seq, std::move(found), false);
+    }
+
+    const runtime_settings settings_;
+    result_function on_result_;
+    frame_pool frames_;
+    bounded_queue<frame> upload_;
+    bounded_queue<frame> uncached_;
+    bounded_queue<frame> display_;
+    bounded_queue<frame> scaled_;
+    bounded_queue<encoded_frame> outgoing_;
+    result_cache cache_;
+    rate_controller rate_;
+    change_detector changes_;
+    std::atomic<std::uint64_t> calls_;
+    std::atomic<std::uint64_t> completed_;
+    std::atomic<std::uint64_t> replies_;
+    std::atomic<std::uint64_t> processed_;
+    Front front_;
+    // the calls still in flight when the scaler stops map their boxes back
+    scale_map scales_;
+    cloud_dispatcher dispatcher_;
+    encode_pool encoders_;
+    scale_stage scaler_;
+    cache_stage cached_;
+    capture_stage capture_;
+};
+
+}
+#endif
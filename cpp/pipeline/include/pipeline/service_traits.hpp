@@ -0,0 +1,140 @@
+#ifndef PIPELINE_SERVICE_TRAITS_HPP
+#define PIPELINE_SERVICE_TRAITS_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/frame.hpp>
+
+#include <opencv2/opencv.hpp>
+#include <rapp/cloud/service_controller.hpp>
+#include <rapp/cloud/vision_detection.hpp>
+#include <rapp/cloud/vision_recognition.hpp>
+#include <rapp/objects/picture.hpp>
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pipeline {
+
+/**
+ * \brief How to call a vision service of the platform and read its reply.
+ * \a call makes the call with the controller and the picture it receives,
+ * gives what was found to \a found as detections and returns true if the
+ * platform replied. \a found is a template parameter, so the conversion
+ * of the reply is inlined in the call.
+ * The picture is passed with std::cref, otherwise make_call would copy it.
+ * \a upload_size is the largest picture the service needs: bigger frames
+ * are scaled down before they are encoded (scale_stage), and the boxes
+ * scaled back.
+ */
+template <class Service>
+struct service_traits;
+
+template <>
+struct service_traits<rapp::cloud::face_detection>
+{
+    static const char * name()
+    {
+        return "face_detection";
+    }
+
+    /// faces a few metres away are still some tens of pixels wide
+    static cv::Size upload_size()
+    {
+        return cv::Size(640, 480);
+    }
+
+    template <class Found>
+    static bool call(rapp::cloud::service_controller & ctrl,
+                     const rapp::object::picture & pic,
+                     Found && found)
+    {
+        bool replied = false;
+        ctrl.make_call<rapp::cloud::face_detection>(std::cref(pic), true,
+            [&](std::vector<rapp::object::face> faces) {
+                replied = true;
+                found(boxes(faces));
+            });
+        return replied;
+    }
+};
+
+template <>
+struct service_traits<rapp::cloud::human_detection>
+{
+    static const char * name()
+    {
+        return "human_detection";
+    }
+
+    /// people must stay taller than the 128 pixels of the detector window
+    static cv::Size upload_size()
+    {
+        return cv::Size(640, 480);
+    }
+
+    template <class Found>
+    static bool call(rapp::cloud::service_controller & ctrl,
+                     const rapp::object::picture & pic,
+                     Found && found)
+    {
+        bool replied = false;
+        ctrl.make_call<rapp::cloud::human_detection>(std::cref(pic),
+            [&](std::vector<rapp::object::human> humans) {
+                replied = true;
+                found(boxes(humans));
+            });
+        return replied;
+    }
+};
+
+template <>
+struct service_traits<rapp::cloud::object_recognition>
+{
+    static const char * name()
+    {
+        return "object_recognition";
+    }
+
+    /// the features of the objects need the details of the picture
+    static cv::Size upload_size()
+    {
+        return cv::Size(800, 600);
+    }
+
+    /// the label of the object, without a box; no detections if nothing was recognised
+    template <class Found>
+    static bool call(rapp::cloud::service_controller & ctrl,
+                     const rapp::object::picture & pic,
+                     Found && found)
+    {
+        bool replied = false;
+        ctrl.make_call<rapp::cloud::object_recognition>(std::cref(pic),
+            [&](std::string object) {
+                replied = true;
+                std::vector<detection> result;
+                if (!object.empty()) {
+                    result.push_back({cv::Rect(), std::move(object)});
+                }
+                found(std::move(result));
+            });
+        return replied;
+    }
+};
+
+}
+#endif
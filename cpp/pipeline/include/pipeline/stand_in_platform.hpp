@@ -0,0 +1,239 @@
+#ifndef PIPELINE_STAND_IN_PLATFORM_HPP
+#define PIPELINE_STAND_IN_PLATFORM_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/bounded_queue.hpp>
+#include <pipeline/clock.hpp>
+
+#include <rapp/cloud/service_controller.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/chrono.hpp>
+#include <boost/chrono/thread_clock.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <istream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+
+namespace pipeline {
+
+/// \brief how the stand-in platform answers
+struct stand_in_settings
+{
+    /// port it listens to, on the loopback interface
+    unsigned short port = 9001;
+    /// time every reply takes at least
+    clock::duration latency = boost::chrono::milliseconds(150);
+    /// mean of the random (exponential) time added to \a latency
+    clock::duration jitter = boost::chrono::milliseconds(50);
+    /// boxes in every face and human reply
+    unsigned int results = 1;
+    /// connections served at the same time, more than the calls in flight of the program
+    unsigned int workers = 16;
+};
+
+/**
+ * \brief A local stand-in for the RAPP platform.
+ * \class stand_in_platform
+ *
+ * It answers the HTTP requests of the vision services of librapp
+ * (`/hop/face_detection`, `/hop/human_detection` and
+ * `/hop/object_recognition_caffe`) with a canned reply after a latency
+ * and a random jitter, so the whole pipeline can be measured on a
+ * computer without network nor platform. The connections are served by
+ * a fixed set of \a workers threads, like the platform serves calls at
+ * the same time, so a long run doesn't pile up threads. The CPU time its
+ * threads spend is counted in \a cpu_time, so a program which runs it in
+ * its own process can leave it out of its figures.
+ * It speaks plain HTTP: librapp has to be configured without TLS.
+ */
+class stand_in_platform
+{
+public:
+    stand_in_platform(stand_in_settings settings = stand_in_settings())
+    : settings_(settings),
+      acceptor_(service_, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), settings.port)),
+      running_(true), requests_(0), bytes_(0), accepted_(settings.workers)
+    {
+        for (unsigned int i = 0; i < settings.workers; ++i) {
+            workers_.create_thread([this]{ work(); });
+        }
+        thread_ = boost::thread([this]{ run(); });
+    }
+
+    /// \brief stop listening and wait for the replies in flight
+    ~stand_in_platform()
+    {
+        running_ = false;
+        /*
+         * accept blocks until a client connects,
+         * so we connect once to wake it up.
+         */
+        try {
+            boost::asio::ip::tcp::socket wake(service_);
+            wake.connect(acceptor_.local_endpoint());
+        }
+        catch (const boost::system::system_error &) {}
+        thread_.join();
+        accepted_.close();
+        workers_.join_all();
+    }
+
+    /// \brief the platform info to give to the controllers
+    rapp::cloud::platform info() const
+    {
+        return {"127.0.0.1", std::to_string(settings_.port), "rapp_token"};
+    }
+
+    /// \brief requests answered so far
+    std::uint64_t requests() const
+    {
+        return requests_;
+    }
+
+    /// \brief bytes received so far (headers and body)
+    std::uint64_t bytes() const
+    {
+        return bytes_;
+    }
+
+    /// \brief CPU time spent so far by the threads of the stand-in
+    boost::chrono::nanoseconds cpu_time() const
+    {
+        return boost::chrono::nanoseconds(cpu_ns_);
+    }
+
+private:
+    void run()
+    {
+        while (running_) {
+            std::shared_ptr<boost::asio::ip::tcp::socket> client(new boost::asio::ip::tcp::socket(service_));
+            boost::system::error_code error;
+            acceptor_.accept(*client, error);
+            if (error || !running_) {
+                continue;
+            }
+            const auto start = boost::chrono::thread_clock::now();
+            accepted_.push(client);
+            count_cpu(start);
+        }
+    }
+
+    void work()
+    {
+        std::shared_ptr<boost::asio::ip::tcp::socket> client;
+        while (accepted_.pop(client)) {
+            const auto start = boost::chrono::thread_clock::now();
+            serve(*client);
+            client.reset();
+            count_cpu(start);
+        }
+    }
+
+    void count_cpu(boost::chrono::thread_clock::time_point start)
+    {
+        cpu_ns_ += boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+                       boost::chrono::thread_clock::now() - start).count();
+    }
+
+    void serve(boost::asio::ip::tcp::socket & client)
+    {
+        const auto arrived = clock::now();
+        try {
+            boost::asio::streambuf buffer;
+            std::size_t header = boost::asio::read_until(client, buffer, "\r\n\r\n");
+            std::istream stream(&buffer);
+            std::string method, path, line;
+            stream >> method >> path;
+            std::size_t length = 0;
+            while (std::getline(stream, line) && line != "\r") {
+                if (line.compare(0, 15, "Content-Length:") == 0) {
+                    length = std::strtoul(line.c_str() + 15, nullptr, 10);
+                }
+            }
+            if (buffer.size() < length) {
+                boost::asio::read(client, buffer, boost::asio::transfer_exactly(length - buffer.size()));
+            }
+            bytes_ += header + length;
+            ++requests_;
+
+            boost::this_thread::sleep_until(arrived + delay());
+
+            const std::string body = reply(path);
+            std::ostringstream out;
+            out << "HTTP/1.1 200 OK\r\n"
+                << "Content-Type: application/json\r\n"
+                << "Content-Length: " << body.size() << "\r\n"
+                << "Connection: close\r\n\r\n"
+                << body;
+            boost::asio::write(client, boost::asio::buffer(out.str()));
+        }
+        catch (const boost::system::system_error &) {}
+    }
+
+    clock::duration delay()
+    {
+        boost::unique_lock<boost::mutex> lock(random_mutex_);
+        const double mean = boost::chrono::duration<double>(settings_.jitter).count();
+        double extra = 0;
+        if (mean > 0) {
+            extra = std::exponential_distribution<double>(1.0 / mean)(random_);
+        }
+        return settings_.latency
+               + boost::chrono::duration_cast<clock::duration>(boost::chrono::duration<double>(extra));
+    }
+
+    std::string reply(const std::string & path) const
+    {
+        if (path.find("object_recognition") != std::string::npos) {
+            return "{\"object_class\":\"stand_in\",\"error\":\"\"}";
+        }
+        const char * name = path.find("human_detection") != std::string::npos ? "humans" : "faces";
+        std::ostringstream out;
+        out << "{\"" << name << "\":[";
+        for (unsigned int i = 0; i < settings_.results; ++i) {
+            const int x = 40 + 60 * i;
+            out << (i ? "," : "")
+                << "{\"up_left_point\":{\"x\":" << x << ",\"y\":40},"
+                << "\"down_right_point\":{\"x\":" << x + 50 << ",\"y\":90}}";
+        }
+        out << "],\"error\":\"\"}";
+        return out.str();
+    }
+
+    const stand_in_settings settings_;
+    boost::asio::io_service service_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    std::atomic<bool> running_;
+    std::atomic<std::uint64_t> requests_;
+    std::atomic<std::uint64_t> bytes_;
+    std::atomic<std::int64_t> cpu_ns_{0};
+    boost::mutex random_mutex_;
+    std::mt19937 random_;
+    bounded_queue<std::shared_ptr<boost::asio::ip::tcp::socket>> accepted_;
+    boost::thread_group workers_;
+    boost::thread thread_;
+};
+
+}
+#endif
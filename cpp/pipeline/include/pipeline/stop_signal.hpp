@@ -0,0 +1,105 @@
+#ifndef PIPELINE_STOP_SIGNAL_HPP
+#define PIPELINE_STOP_SIGNAL_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/clock.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <csignal>
+
+namespace pipeline {
+
+/**
+ * \brief Asks the program to stop on SIGINT (Ctrl+C) or SIGTERM.
+ * \class stop_signal
+ *
+ * The signals are caught by boost::asio in a thread of its own, so the
+ * handler can wake the threads which \a wait, and the stages still stop
+ * in order when they go out of scope. Anything else (e.g. a key in the
+ * window) can also \a request the stop.
+ */
+class stop_signal
+{
+public:
+    stop_signal()
+    : signals_(service_, SIGINT, SIGTERM), stopped_(false)
+    {
+        signals_.async_wait([this](const boost::system::error_code & error, int) {
+            if (!error) {
+                request();
+            }
+        });
+        thread_ = boost::thread([this]{ service_.run(); });
+    }
+
+    ~stop_signal()
+    {
+        service_.stop();
+        thread_.join();
+    }
+
+    /// \brief ask every waiting thread to stop
+    void request()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        stopped_ = true;
+        condition_.notify_all();
+    }
+
+    /// \brief true once a signal has arrived or \a request has been called
+    bool requested() const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        return stopped_;
+    }
+
+    /// \brief wait until the stop is requested
+    void wait()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while (!stopped_) {
+            condition_.wait(lock);
+        }
+    }
+
+    /// \brief wait for the stop at most \a timeout, true if it was requested
+    bool wait_for(clock::duration timeout)
+    {
+        const auto deadline = clock::now() + timeout;
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while (!stopped_) {
+            if (condition_.wait_until(lock, deadline) == boost::cv_status::timeout) {
+                break;
+            }
+        }
+        return stopped_;
+    }
+
+private:
+    boost::asio::io_service service_;
+    boost::asio::signal_set signals_;
+    mutable boost::mutex mutex_;
+    boost::condition_variable condition_;
+    bool stopped_;
+    boost::thread thread_;
+};
+
+}
+#endif
@@ -0,0 +1,97 @@
+#ifndef PIPELINE_USB_CAMERA_HPP
+#define PIPELINE_USB_CAMERA_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/frame_source.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <boost/chrono.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <atomic>
+#include <utility>
+
+namespace pipeline {
+
+/**
+ * \brief A camera read with cv::VideoCapture on its own thread.
+ * \class usb_camera
+ *
+ * Like nao_camera and replay_camera it keeps the newest frame,
+ * so several cameras can be used by the same program.
+ * The frames are read into a small frame_pool: the newest frame, the one
+ * being read and the ones the consumers still hold.
+ */
+class usb_camera : public streaming_source
+{
+public:
+    explicit usb_camera(int device, int width = 640, int height = 480)
+    : capture_(device), frames_(4), running_(true)
+    {
+        capture_.set(CV_CAP_PROP_FRAME_WIDTH, width);
+        capture_.set(CV_CAP_PROP_FRAME_HEIGHT, height);
+        if (capture_.isOpened()) {
+            thread_ = boost::thread([this]{ run(); });
+        }
+    }
+
+    ~usb_camera()
+    {
+        running_ = false;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    bool opened() const
+    {
+        return capture_.isOpened();
+    }
+
+private:
+    void run()
+    {
+        while (running_) {
+            /*
+             * The newest frame may still be encoded or displayed by
+             * someone else: read into a free buffer of the pool, or into
+             * a new cv::Mat when the consumers hold all of them.
+             */
+            frame_pool::lease buffer = frames_.acquire();
+            cv::Mat image;
+            if (buffer) {
+                image = *buffer;
+            }
+            if (!capture_.read(image) || image.empty()) {
+                boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+                continue;
+            }
+            if (buffer) {
+                *buffer = image;
+            }
+            publish(image, std::move(buffer));
+        }
+    }
+
+    cv::VideoCapture capture_;
+    frame_pool frames_;
+    std::atomic<bool> running_;
+    boost::thread thread_;
+};
+
+}
+#endif
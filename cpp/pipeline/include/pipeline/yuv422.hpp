@@ -0,0 +1,234 @@
+#ifndef PIPELINE_YUV422_HPP
+#define PIPELINE_YUV422_HPP
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <opencv2/opencv.hpp>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#include <algorithm>
+
+namespace pipeline {
+
+/**
+ * \brief Conversion of the native YUV422 frames of NAO (AL::kYUV422ColorSpace).
+ * \class yuv422
+ *
+ * The camera of NAO gives YUYV: two pixels in four bytes, Y0 U Y1 V,
+ * a CV_8UC2 image. Subscribing in BGR makes NAOqi convert every frame on
+ * the Atom before we encode it again, often to grayscale, for services
+ * which never look at the colour. These kernels start from the native
+ * frame instead:
+ *
+ * - \a to_gray keeps only the luminance (Y, studio range 16 - 235, like
+ *   AL::kYuvColorSpace), which is all face and human detection need:
+ *   16 pixels are packed with two SSE2 instructions.
+ * - \a to_bgr converts with the BT.601 coefficients of OpenCV in 13 bits
+ *   fixed point (within one or two levels of cv::cvtColor), 16 pixels at
+ *   a time with SSE2, interleaved into BGR with the shuffles of SSSE3.
+ *
+ * The kernels are chosen when the program is compiled (the Atom build
+ * profile has both instruction sets); \a simd false, or a compiler
+ * without them, runs the scalar kernels, which give the same result.
+ * The width must be even.
+ */
+struct yuv422
+{
+    /// \brief the instructions of the kernels: "ssse3", "sse2" or "scalar"
+    static const char * kernels()
+    {
+#if defined(__SSSE3__)
+        return "ssse3";
+#elif defined(__SSE2__)
+        return "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+    /// \brief the luminance of \a yuyv in \a gray (CV_8UC1, reused if it has the size)
+    static void to_gray(const cv::Mat & yuyv, cv::Mat & gray, bool simd = true)
+    {
+        CV_Assert(yuyv.type() == CV_8UC2);
+        gray.create(yuyv.rows, yuyv.cols, CV_8UC1);
+        for (int y = 0; y < yuyv.rows; ++y) {
+            gray_row(yuyv.ptr<uchar>(y), gray.ptr<uchar>(y), yuyv.cols, simd);
+        }
+    }
+
+    /// \brief \a yuyv in colour in \a bgr (CV_8UC3, reused if it has the size)
+    static void to_bgr(const cv::Mat & yuyv, cv::Mat & bgr, bool simd = true)
+    {
+        CV_Assert(yuyv.type() == CV_8UC2);
+        bgr.create(yuyv.rows, yuyv.cols, CV_8UC3);
+        for (int y = 0; y < yuyv.rows; ++y) {
+            bgr_row(yuyv.ptr<uchar>(y), bgr.ptr<uchar>(y), yuyv.cols, simd);
+        }
+    }
+
+    /// \brief the luminance of \a width pixels of \a src in \a gray
+    static void gray_row(const uchar * src, uchar * gray, int width, bool simd = true)
+    {
+        int x = 0;
+#if defined(__SSE2__)
+        if (simd) {
+            const __m128i luma = _mm_set1_epi16(0x00ff);
+            for (; x + 16 <= width; x += 16) {
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * x));
+                const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * x + 16));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(gray + x),
+                                 _mm_packus_epi16(_mm_and_si128(a, luma), _mm_and_si128(b, luma)));
+            }
+        }
+#else
+        (void) simd;
+#endif
+        for (; x < width; ++x) {
+            gray[x] = src[2 * x];
+        }
+    }
+
+    /// \brief \a width pixels of \a src in colour in \a bgr
+    static void bgr_row(const uchar * src, uchar * bgr, int width, bool simd = true)
+    {
+        int x = 0;
+#if defined(__SSE2__)
+        if (simd) {
+            for (; x + 16 <= width; x += 16) {
+                __m128i b, g, r;
+                convert16(src + 2 * x, b, g, r);
+                interleave16(b, g, r, bgr + 3 * x);
+            }
+        }
+#else
+        (void) simd;
+#endif
+        for (; x + 1 < width; x += 2) {
+            const int u = src[2 * x + 1] - 128;
+            const int v = src[2 * x + 3] - 128;
+            const int ruv = v * cvr;
+            const int guv = u * cug + v * cvg;
+            const int buv = u * cub;
+            for (int i = 0; i < 2; ++i) {
+                const int luma = std::max(0, src[2 * (x + i)] - 16) * cy + round;
+                uchar * pixel = bgr + 3 * (x + i);
+                pixel[0] = saturate((luma + buv) >> shift);
+                pixel[1] = saturate((luma + guv) >> shift);
+                pixel[2] = saturate((luma + ruv) >> shift);
+            }
+        }
+    }
+
+private:
+    /// BT.601 studio range, as cv::cvtColor, in 1/8192
+    enum { shift = 13, round = 1 << (shift - 1),
+           cy = 9535, cvr = 13074, cug = -3203, cvg = -6660, cub = 16531 };
+
+    static uchar saturate(int value)
+    {
+        return static_cast<uchar>(std::min(255, std::max(0, value)));
+    }
+
+#if defined(__SSE2__)
+    /// \brief the blue, green and red of 16 pixels of \a src
+    static void convert16(const uchar * src, __m128i & b, __m128i & g, __m128i & r)
+    {
+        __m128i out[3][2];
+        for (int half = 0; half < 2; ++half) {
+            const __m128i yuyv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16 * half));
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i luma = _mm_max_epi16(_mm_sub_epi16(_mm_and_si128(yuyv, _mm_set1_epi16(0x00ff)),
+                                                             _mm_set1_epi16(16)),
+                                               zero);
+            // U0 V0 U1 V1 ... minus 128, then U and V repeated for both pixels of a pair
+            const __m128i chroma = _mm_sub_epi16(_mm_srli_epi16(yuyv, 8), _mm_set1_epi16(128));
+            const __m128i u = _mm_and_si128(chroma, _mm_set1_epi32(0x0000ffff));
+            const __m128i v = _mm_srli_epi32(chroma, 16);
+            const __m128i uu = _mm_or_si128(u, _mm_slli_epi32(u, 16));
+            const __m128i vv = _mm_or_si128(v, _mm_slli_epi32(v, 16));
+
+            const __m128i rounding = _mm_set1_epi32(round);
+            const __m128i luma_lo = _mm_unpacklo_epi16(luma, zero);
+            const __m128i luma_hi = _mm_unpackhi_epi16(luma, zero);
+            const __m128i y_only = _mm_set1_epi32(cy);
+            const __m128i y_lo = _mm_add_epi32(_mm_madd_epi16(luma_lo, y_only), rounding);
+            const __m128i y_hi = _mm_add_epi32(_mm_madd_epi16(luma_hi, y_only), rounding);
+
+            const __m128i to_b = _mm_set1_epi32(cub);
+            const __m128i to_r = _mm_set1_epi32(cvr);
+            const __m128i to_g = _mm_setr_epi16(cug, cvg, cug, cvg, cug, cvg, cug, cvg);
+            const __m128i b_lo = _mm_madd_epi16(_mm_unpacklo_epi16(uu, zero), to_b);
+            const __m128i b_hi = _mm_madd_epi16(_mm_unpackhi_epi16(uu, zero), to_b);
+            const __m128i r_lo = _mm_madd_epi16(_mm_unpacklo_epi16(vv, zero), to_r);
+            const __m128i r_hi = _mm_madd_epi16(_mm_unpackhi_epi16(vv, zero), to_r);
+            const __m128i g_lo = _mm_madd_epi16(_mm_unpacklo_epi16(uu, vv), to_g);
+            const __m128i g_hi = _mm_madd_epi16(_mm_unpackhi_epi16(uu, vv), to_g);
+
+            out[0][half] = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(y_lo, b_lo), shift),
+                                           _mm_srai_epi32(_mm_add_epi32(y_hi, b_hi), shift));
+            out[1][half] = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(y_lo, g_lo), shift),
+                                           _mm_srai_epi32(_mm_add_epi32(y_hi, g_hi), shift));
+            out[2][half] = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(y_lo, r_lo), shift),
+                                           _mm_srai_epi32(_mm_add_epi32(y_hi, r_hi), shift));
+        }
+        b = _mm_packus_epi16(out[0][0], out[0][1]);
+        g = _mm_packus_epi16(out[1][0], out[1][1]);
+        r = _mm_packus_epi16(out[2][0], out[2][1]);
+    }
+
+    /// \brief write 16 pixels as 48 bytes of BGR in \a bgr
+    static void interleave16(__m128i b, __m128i g, __m128i r, uchar * bgr)
+    {
+#if defined(__SSSE3__)
+        const __m128i b0 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+        const __m128i g0 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+        const __m128i r0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+        const __m128i b1 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+        const __m128i g1 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+        const __m128i r1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+        const __m128i b2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+        const __m128i g2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+        const __m128i r2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+        __m128i * out = reinterpret_cast<__m128i*>(bgr);
+        _mm_storeu_si128(out, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, b0), _mm_shuffle_epi8(g, g0)),
+                                           _mm_shuffle_epi8(r, r0)));
+        _mm_storeu_si128(out + 1, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, b1), _mm_shuffle_epi8(g, g1)),
+                                               _mm_shuffle_epi8(r, r1)));
+        _mm_storeu_si128(out + 2, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, b2), _mm_shuffle_epi8(g, g2)),
+                                               _mm_shuffle_epi8(r, r2)));
+#else
+        // SSE2 has no byte shuffle: the planes go through the stack
+        alignas(16) uchar planes[3][16];
+        _mm_store_si128(reinterpret_cast<__m128i*>(planes[0]), b);
+        _mm_store_si128(reinterpret_cast<__m128i*>(planes[1]), g);
+        _mm_store_si128(reinterpret_cast<__m128i*>(planes[2]), r);
+        for (int i = 0; i < 16; ++i) {
+            bgr[3 * i] = planes[0][i];
+            bgr[3 * i + 1] = planes[1][i];
+            bgr[3 * i + 2] = planes[2][i];
+        }
+#endif
+    }
+#endif
+};
+
+}
+#endif
@@ -0,0 +1,87 @@
+/**
+ * Copyright 2015 RAPP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * #http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pipeline/box_tracker.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+/// pixels the square moves right on every frame
+static const int speed = 4;
+
+/// \brief where the square is in frame \a seq
+static cv::Rect square(std::uint64_t seq)
+{
+    return cv::Rect(20 + speed * static_cast<int>(seq), 80, 60, 60);
+}
+
+/// \brief frame \a seq: a textured square moving right on a gray background
+static pipeline::frame scene(std::uint64_t seq)
+{
+    static cv::Mat texture;
+    if (texture.empty()) {
+        texture.create(60, 60, CV_8UC3);
+        cv::RNG rng(7);
+        rng.fill(texture, cv::RNG::UNIFORM, 0, 256);
+        cv::GaussianBlur(texture, texture, cv::Size(5, 5), 0);
+    }
+    pipeline::frame next;
+    next.seq = seq;
+    next.image = cv::Mat(240, 320, CV_8UC3, cv::Scalar(128, 128, 128));
+    texture.copyTo(next.image(square(seq)));
+    return next;
+}
+
+/**
+ * \brief Anchors the square found in frame \a found_in on a tracker which
+ *  was given only the even frames up to \a newest, and checks that the
+ *  box is on the square of the newest frame, within \a tolerance pixels.
+ */
+static bool anchored(std::uint64_t found_in, std::uint64_t newest, int tolerance)
+{
+    pipeline::box_tracker tracker;
+    for (std::uint64_t seq = 0; seq <= newest; seq += 2) {
+        tracker.update(scene(seq));
+    }
+    tracker.anchor(found_in, {{square(found_in), "face"}});
+
+    const std::vector<pipeline::detection> boxes = tracker.boxes();
+    const cv::Rect expected = square(newest);
+    if (boxes.size() != 1
+        || std::abs(boxes[0].box.x - expected.x) > tolerance
+        || std::abs(boxes[0].box.y - expected.y) > tolerance) {
+        std::cerr << "Result of frame " << found_in << ": expected " << expected << " on frame " << newest
+                  << ", got " << (boxes.empty() ? cv::Rect() : boxes[0].box) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    bool ok = true;
+    // the frame of the result is in the history
+    ok &= anchored(6, 10, 3);
+    // the window skipped the frame of the result: seeded on frame 4, one frame of motion off
+    ok &= anchored(5, 10, speed + 3);
+    if (ok) {
+        std::cout << "box_tracker: ok" << std::endl;
+    }
+    return ok ? 0 : 1;
+}